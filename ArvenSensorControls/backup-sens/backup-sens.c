@@ -3,14 +3,41 @@
  *
  * Created: 2023-02-25
  * Author: Kia Skretteberg
- */ 
+ */
 #include <avr/io.h>
+#include <avr/interrupt.h>
 #include "backup-sens.h"
+#include "timer.h"
+#include "event.h"
+
+// not on this robot, leave the whole driver out
+#if BOARD_BACK_SENS
+
+#define BACK_SENS_COUNT 2
 
 /************************************************************************/
 /* Local Definitions (private functions)                                */
 /************************************************************************/
 
+// Index of the switch in the tables below (0 = L / INT0, 1 = R / INT1), BACK_SENS_COUNT if not a switch
+unsigned char sensIndex(int sens);
+
+// Pin of the switch at index
+int sensPin(unsigned char index);
+
+
+/************************************************************************/
+/* Global Variables                                                     */
+/************************************************************************/
+
+// debounced state and when the change started, per switch
+volatile char sensState[BACK_SENS_COUNT];
+volatile unsigned long sensEdgeTime[BACK_SENS_COUNT];
+// time of the first edge of a change still settling
+volatile unsigned long sensPendingTime[BACK_SENS_COUNT];
+// bits for switches waiting out their debounce time (interrupt masked until then)
+volatile unsigned char sensSettling = 0;
+
 
 /************************************************************************/
 /* Header Implementation                                                */
@@ -24,22 +51,133 @@ void Back_Sens_InitAll(void)
 
 void Back_Sens_InitSens(int sens)
 {
+	unsigned char index = sensIndex(sens);
+
+	if(index >= BACK_SENS_COUNT)
+	{
+		return;
+	}
+
 	DDRD &= ~sens; //input
-	
-	PCMSK2 |= sens; // turn on PCINT18/19 pin mask (enable interrupts) (12.2.6)
-	PCICR |= 0b00000100; // turn on interrupts for group 2 (12.2.4)
+
+	sensState[index] = (PIND & sens) != 0;
+	sensEdgeTime[index] = Timer_Now();
+	Back_Sens_SetEdge(sens, Back_Sens_Edge_Any);
+	EIFR = 1 << index; // clear anything latched while it was being set up (13.2.3)
+	EIMSK |= 1 << index; // turn on INT0/INT1 (13.2.2)
 }
 
-char Back_Sens_ISR(int pin)
+void Back_Sens_SetEdge(int sens, Back_Sens_Edge edge)
 {
-	// check if this sensor was hit
-	if(PIND & pin)
+	unsigned char index = sensIndex(sens);
+
+	if(index >= BACK_SENS_COUNT)
+	{
+		return;
+	}
+
+	// ISCn1:ISCn0, two bits per interrupt (13.2.1)
+	EICRA = (EICRA & ~(0b11 << (index * 2))) | (edge << (index * 2));
+}
+
+char Back_Sens_GetState(int sens)
+{
+	unsigned char index = sensIndex(sens);
+
+	return index < BACK_SENS_COUNT ? sensState[index] : 0;
+}
+
+unsigned long Back_Sens_GetEdgeTime(int sens)
+{
+	unsigned char index = sensIndex(sens);
+	unsigned long time = 0;
+
+	if(index < BACK_SENS_COUNT)
 	{
-		return 1;
+		// 32 bits updated from the timer ISR
+		unsigned char sreg = SREG;
+		cli();
+		time = sensEdgeTime[index];
+		SREG = sreg;
 	}
-	return 0;
+	return time;
 }
 
+void Back_Sens_ISR(int sens)
+{
+	unsigned char index = sensIndex(sens);
+
+	if(index >= BACK_SENS_COUNT)
+	{
+		return;
+	}
+
+	// first edge of a (possibly bouncing) change, hold the interrupt off until it settles
+	EIMSK &= ~(1 << index);
+	sensPendingTime[index] = Timer_Now();
+	sensSettling |= 1 << index;
+}
+
+void Back_Sens_TimerISR(void)
+{
+	unsigned long now;
+
+	if(!sensSettling)
+	{
+		return;
+	}
+
+	now = Timer_Now();
+	for(unsigned char index = 0; index < BACK_SENS_COUNT; ++index)
+	{
+		if((sensSettling & (1 << index)) && now - sensPendingTime[index] >= Back_Sens_DEBOUNCE)
+		{
+			char state = (PIND & sensPin(index)) != 0;
+
+			if(state != sensState[index])
+			{
+				sensState[index] = state;
+				sensEdgeTime[index] = sensPendingTime[index];
+				Event_Post(state ? Event_BumpPress : Event_BumpRelease, index, sensPendingTime[index]);
+			}
+			// otherwise it's back where it was, anything shorter than the debounce time is noise (eg. the
+			// motors), not a bump, so there's nothing to post
+
+			// anything latched while it bounced is old news
+			EIFR = 1 << index;
+			if(((PIND & sensPin(index)) != 0) != state)
+			{
+				// moved again just as it was sampled, that edge was cleared above so settle it again
+				sensPendingTime[index] = now;
+				continue;
+			}
+			sensSettling &= ~(1 << index);
+			EIMSK |= 1 << index;
+		}
+	}
+}
+
+
 /************************************************************************/
 /* Local  Implementation                                                */
-/************************************************************************/
\ No newline at end of file
+/************************************************************************/
+
+unsigned char sensIndex(int sens)
+{
+	switch(sens)
+	{
+		case Back_Sens_L:
+			return 0;
+		case Back_Sens_R:
+			return 1;
+		default:
+			return BACK_SENS_COUNT;
+	}
+}
+
+int sensPin(unsigned char index)
+{
+	return index ? Back_Sens_R : Back_Sens_L;
+}
+
+#endif
@@ -1,19 +1,50 @@
 /*
  * backup_sens.h
  * Snap Action Switches
- * Utilizes GPIO
+ * Utilizes GPIO, external interrupts INT0/INT1, the Timer1 timebase (timer.h) and the event queue (event.h)
  *
  * Created: 2023-02-25
  * Author: Kia Skretteberg
- */ 
-#define Back_Sens_L 0b00000100 // PORTD
-#define Back_Sens_R 0b01001000 // PORTD
+ */
+#include "../board.h"
+
+// pins come from the board profile (PORTD, on INT0 / INT1)
+#define Back_Sens_L BOARD_BACK_SENS_L
+#define Back_Sens_R BOARD_BACK_SENS_R
+
+// A change has to hold this long (Timer_Now counts, 0.5us) before it's accepted, 5ms covers snap action bounce
+// The switch's interrupt is off for that time, so bounce costs nothing past the first edge
+#define Back_Sens_DEBOUNCE 10000
+
+// Edge (or level) that raises the switch's external interrupt, EICRA ISCn1:ISCn0 (13.2.1)
+typedef enum
+{
+	Back_Sens_Edge_Low = 0,     // held low, fires continuously (don't use with a pressed switch held low)
+	Back_Sens_Edge_Any = 1,     // both edges, the stable state follows every press and release (default)
+	Back_Sens_Edge_Falling = 2, // releases only
+	Back_Sens_Edge_Rising = 3   // presses only, a release isn't seen until the next press
+} Back_Sens_Edge;
 
 // Initialize all backup sensors (switches)
 void Back_Sens_InitAll(void);
 
-// Initialize the specified switch as input with interrupts enabled
+// Initialize the specified switch as input with its external interrupt on any edge
 void Back_Sens_InitSens(int sens);
 
-// ISR for detecting if a backup sensor was triggered, if either triggered returns 1, else 0
-char Back_Sens_ISR(int pin);
\ No newline at end of file
+// Change which edge raises the switch's interrupt
+void Back_Sens_SetEdge(int sens, Back_Sens_Edge edge);
+
+// Debounced state of the switch, 1 if there's an obstacle
+char Back_Sens_GetState(int sens);
+
+// Timer_Now time of the first edge of the switch's last accepted change
+unsigned long Back_Sens_GetEdgeTime(int sens);
+
+// ISR for the switch's external interrupt, call from INT0_vect (Back_Sens_L) / INT1_vect (Back_Sens_R)
+void Back_Sens_ISR(int sens);
+
+// Settles any switch whose debounce time is up, call from a periodic timer ISR (eg. TIMER1_COMPA_vect)
+// Every accepted press and release is queued (event.h) with the time of its first edge, so one that
+// comes and goes between two GetState calls isn't lost. Anything over before the debounce time is up
+// is treated as noise and never queued
+void Back_Sens_TimerISR(void);
@@ -0,0 +1,98 @@
+/*
+ * battery.c
+ *
+ * Created: 2026-10-17
+ */
+#include <avr/io.h>
+#include "atd.h"
+#include "../board.h"
+#include "battery.h"
+
+/************************************************************************/
+/* Local Definitions (private functions)                                */
+/************************************************************************/
+
+// full scale of an oversampled result, 10 + n bits
+#define BATTERY_FULL_SCALE(oversample) (1024UL << (oversample))
+
+/************************************************************************/
+/* Global Variables                                                     */
+/************************************************************************/
+
+// where the readings are in the AtoD scan list
+unsigned char batteryBandgapIndex = 0;
+unsigned char batteryDividerIndex = 0;
+// last worked out voltages, and the low flag
+unsigned int batterySupply = 0;
+unsigned int batteryVoltage = 0;
+char batteryLow = 0;
+
+/************************************************************************/
+/* Header Implementation                                                */
+/************************************************************************/
+
+void Battery_Init(unsigned char bandgapIndex, unsigned char dividerIndex)
+{
+	batteryBandgapIndex = bandgapIndex;
+	batteryDividerIndex = dividerIndex;
+	batterySupply = 0;
+	batteryVoltage = 0;
+	batteryLow = 0;
+}
+
+int Battery_Update(void)
+{
+	struct AtoD_ScanResult bandgap;
+
+	if(AtoD_ScanRead(batteryBandgapIndex, &bandgap) || !bandgap.Value)
+	{
+		return -1;
+	}
+
+	// bandgap = 1.1V * full scale / reference, turned around for the reference (rounded)
+	batterySupply = (unsigned int)((BATTERY_BANDGAP_MV * BATTERY_FULL_SCALE(BATTERY_BANDGAP_OVERSAMPLE)
+		+ bandgap.Value / 2) / bandgap.Value);
+	batteryVoltage = batterySupply;
+
+#if BOARD_BATTERY_DIV
+	struct AtoD_ScanResult divider;
+
+	if(AtoD_ScanRead(batteryDividerIndex, &divider))
+	{
+		return -1;
+	}
+	// divider pin against the reference, scaled back up to the battery, 12 bits * 5000mV * 3 still fits 32 bits
+	batteryVoltage = (unsigned int)((unsigned long)divider.Value * batterySupply * BATTERY_DIVIDER_NUM
+		/ (BATTERY_FULL_SCALE(BATTERY_DIVIDER_OVERSAMPLE) * BATTERY_DIVIDER_DEN));
+#endif
+
+	// only change state past the far threshold
+	if(!batteryLow && batteryVoltage < BATTERY_LOW_MV)
+	{
+		batteryLow = 1;
+	}
+	else if(batteryLow && batteryVoltage > BATTERY_OK_MV)
+	{
+		batteryLow = 0;
+	}
+	return 0;
+}
+
+unsigned int Battery_GetMillivolts(void)
+{
+	return batteryVoltage;
+}
+
+unsigned int Battery_GetSupplyMillivolts(void)
+{
+	return batterySupply;
+}
+
+char Battery_IsLow(void)
+{
+	return batteryLow;
+}
+
+/************************************************************************/
+/* Local  Implementation                                                */
+/************************************************************************/
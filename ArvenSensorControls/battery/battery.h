@@ -0,0 +1,63 @@
+/*
+ * battery.h
+ * Battery monitor, the AtoD reference voltage from the internal 1.1V bandgap read against it
+ * (the supply, AREF is tied to it), optionally the battery itself through a resistor divider (BOARD_BATTERY_DIV)
+ * Utilizes the AtoD channel scan (atd.h), the bandgap and divider on the same reference
+ *
+ * Created: 2026-10-17
+ */
+
+// bandgap voltage in mV, 1.1V nominal but anywhere from 1.0 to 1.2V from chip to chip (28.8),
+// measure Vcc with a meter against what's reported and trim this to match
+#ifndef BATTERY_BANDGAP_MV
+#define BATTERY_BANDGAP_MV 1100
+#endif
+
+// bandgap oversampling to put in the scan list, 4^3 samples for 13 bits (~3mV of Vcc per count at 5V)
+#define BATTERY_BANDGAP_OVERSAMPLE 3
+// divider oversampling, 4^2 samples for 12 bits
+#define BATTERY_DIVIDER_OVERSAMPLE 2
+
+// battery voltage = divider voltage * NUM / DEN, (R1 + R2) / R2 for R1 from the battery to the pin, R2 to ground
+#ifndef BATTERY_DIVIDER_NUM
+#define BATTERY_DIVIDER_NUM 3
+#endif
+#ifndef BATTERY_DIVIDER_DEN
+#define BATTERY_DIVIDER_DEN 1
+#endif
+
+// low battery below BATTERY_LOW_MV, not clear again until above BATTERY_OK_MV, so it doesn't flicker as the
+// voltage sags and recovers with the load. On Vcc alone the regulator hides the battery until it drops out,
+// so only a supply already sagging below 5V is flagged
+#ifndef BATTERY_LOW_MV
+#if BOARD_BATTERY_DIV
+#define BATTERY_LOW_MV 6800   // 2S lithium pack, ~3.4V a cell
+#else
+#define BATTERY_LOW_MV 4600
+#endif
+#endif
+#ifndef BATTERY_OK_MV
+#if BOARD_BATTERY_DIV
+#define BATTERY_OK_MV 7200
+#else
+#define BATTERY_OK_MV 4750
+#endif
+#endif
+
+// Read the bandgap from entry bandgapIndex of the AtoD scan (AtoD_ScanInit), and the divider from entry
+// dividerIndex (ignored without BOARD_BATTERY_DIV)
+void Battery_Init(unsigned char bandgapIndex, unsigned char dividerIndex);
+
+// Work out the voltage from the latest scan results and update the low flag, never waits
+// Cheap (a couple of 32 bit divides), but there's no need for it more than a few times a second
+// zero on updated, otherwise the scan has no results yet and nothing changed
+int Battery_Update(void);
+
+// Battery voltage in mV as of the last Battery_Update (Vcc without a divider), 0 until the first
+unsigned int Battery_GetMillivolts(void);
+
+// Supply (AtoD reference) voltage in mV as of the last Battery_Update, 0 until the first
+unsigned int Battery_GetSupplyMillivolts(void);
+
+// 1 if the battery is low, with hysteresis (BATTERY_LOW_MV / BATTERY_OK_MV)
+char Battery_IsLow(void);
@@ -0,0 +1,183 @@
+/*
+ * board.h
+ * Board profile, every ATmega328P pin the firmware uses, who owns it and what for
+ * Driver pin masks and interrupt setup come from here, the checks at the bottom
+ * stop the build if two owners end up on the same pin or a pin can't do its job
+ *
+ * Created: 2026-10-17
+ */
+
+/************************************************************************/
+/* Robot variant, drivers to build (0 compiles the driver away)         */
+/************************************************************************/
+
+// override any of these from the project's symbols (eg. BOARD_SEN0427=0) for a leaner build
+#ifndef BOARD_HCSR04
+#define BOARD_HCSR04 1      // ultrasonic sensors
+#endif
+#ifndef BOARD_BACK_SENS
+#define BOARD_BACK_SENS 1   // bump switches
+#endif
+#ifndef BOARD_SEN0427
+#define BOARD_SEN0427 1     // IR range sensors (I2C)
+#endif
+#ifndef BOARD_GD03
+#define BOARD_GD03 1        // weight sensor (AtoD)
+#endif
+#ifndef BOARD_LM75A
+#define BOARD_LM75A 1       // temperature sensor (I2C)
+#endif
+#ifndef BOARD_BATTERY_DIV
+#define BOARD_BATTERY_DIV 0 // battery voltage divider on an AtoD pin (otherwise only Vcc is monitored)
+#endif
+
+// anything on the I2C bus needs the TWI pins
+#define BOARD_I2C (BOARD_SEN0427 || BOARD_LM75A)
+
+/************************************************************************/
+/* Pins                                                                 */
+/************************************************************************/
+
+// ports, numbered the same as the pin change groups (PCINT_Port)
+#define BOARD_PORT_B 0
+#define BOARD_PORT_C 1
+#define BOARD_PORT_D 2
+
+// bit of pin n in its port
+#define BOARD_PIN(n) (1 << (n))
+
+// port registers for a BOARD_PORT_ number (a constant, so these fold down to the register itself)
+#define BOARD_PORT_REG(port) (*((port) == BOARD_PORT_B ? &PORTB : (port) == BOARD_PORT_C ? &PORTC : &PORTD))
+#define BOARD_DDR_REG(port)  (*((port) == BOARD_PORT_B ? &DDRB : (port) == BOARD_PORT_C ? &DDRC : &DDRD))
+#define BOARD_PIN_REG(port)  (*((port) == BOARD_PORT_B ? &PINB : (port) == BOARD_PORT_C ? &PINC : &PIND))
+
+// Pico (SCI0), fixed function
+#define BOARD_PICO_RX_PORT        BOARD_PORT_D
+#define BOARD_PICO_RX             BOARD_PIN(0) // PD0 / RXD
+#define BOARD_PICO_TX_PORT        BOARD_PORT_D
+#define BOARD_PICO_TX             BOARD_PIN(1) // PD1 / TXD
+
+// status LED
+#define BOARD_LED_PORT            BOARD_PORT_C
+#define BOARD_LED                 BOARD_PIN(2) // PC2, pin 25
+
+// bump switches, have to be on the external interrupt pins
+#define BOARD_BACK_SENS_L_PORT    BOARD_PORT_D
+#define BOARD_BACK_SENS_L         BOARD_PIN(2) // PD2 / INT0
+#define BOARD_BACK_SENS_R_PORT    BOARD_PORT_D
+#define BOARD_BACK_SENS_R         BOARD_PIN(3) // PD3 / INT1
+
+// ultrasonic sensors, echo pins on a pin change group with an ISR (B or D)
+#define BOARD_HCSR04_L_TRIG_PORT  BOARD_PORT_D
+#define BOARD_HCSR04_L_TRIG       BOARD_PIN(5) // PD5
+#define BOARD_HCSR04_L_ECHO_PORT  BOARD_PORT_D
+#define BOARD_HCSR04_L_ECHO       BOARD_PIN(6) // PD6 / PCINT22
+#define BOARD_HCSR04_C_TRIG_PORT  BOARD_PORT_D
+#define BOARD_HCSR04_C_TRIG       BOARD_PIN(7) // PD7
+#define BOARD_HCSR04_C_ECHO_PORT  BOARD_PORT_B
+#define BOARD_HCSR04_C_ECHO       BOARD_PIN(0) // PB0 / PCINT0 / ICP1
+#define BOARD_HCSR04_R_TRIG_PORT  BOARD_PORT_B
+#define BOARD_HCSR04_R_TRIG       BOARD_PIN(1) // PB1
+#define BOARD_HCSR04_R_ECHO_PORT  BOARD_PORT_B
+#define BOARD_HCSR04_R_ECHO       BOARD_PIN(2) // PB2 / PCINT2
+
+// IR sensors, left sensor's enable (held off while the right one is readdressed)
+#define BOARD_SEN0427_L_EN_PORT   BOARD_PORT_D
+#define BOARD_SEN0427_L_EN        BOARD_PIN(4) // PD4
+// and each sensor's GPIO1 (new sample interrupt, open drain), on a pin change group with an ISR (B or D)
+// PB5/PB4 are also SCK/MISO for ISP, and a sensor holds GPIO1 low while a sample is pending, so unplug the
+// sensors (or hold their CE low) while programming in-circuit
+#define BOARD_SEN0427_L_INT_PORT  BOARD_PORT_B
+#define BOARD_SEN0427_L_INT       BOARD_PIN(5) // PB5 / PCINT5
+#define BOARD_SEN0427_R_INT_PORT  BOARD_PORT_B
+#define BOARD_SEN0427_R_INT       BOARD_PIN(4) // PB4 / PCINT4
+
+// weight sensor, AtoD channel 0
+#define BOARD_GD03_AIN_PORT       BOARD_PORT_C
+#define BOARD_GD03_AIN            BOARD_PIN(0) // PC0 / ADC0
+
+// battery voltage divider, AtoD channel 1
+#define BOARD_BATTERY_AIN_PORT    BOARD_PORT_C
+#define BOARD_BATTERY_AIN         BOARD_PIN(1) // PC1 / ADC1
+
+// AtoD reference every scan channel uses (AtoD_Reference), AREF as the AtoD has always run. Only change it
+// against the schematic: if AREF is driven, selecting AVcc or 1.1V shorts the internal reference to it
+#ifndef BOARD_ATOD_REF
+#define BOARD_ATOD_REF            0 // AtoD_Ref_AREF
+#endif
+
+// I2C (TWI), fixed function
+#define BOARD_I2C_SDA_PORT        BOARD_PORT_C
+#define BOARD_I2C_SDA             BOARD_PIN(4) // PC4 / SDA
+#define BOARD_I2C_SCL_PORT        BOARD_PORT_C
+#define BOARD_I2C_SCL             BOARD_PIN(5) // PC5 / SCL
+
+/************************************************************************/
+/* Allocation checks                                                    */
+/************************************************************************/
+
+// pin's mask if its owner is built and it's on port, otherwise 0
+#define BOARD_USE(enabled, pinPort, pin, port) ((enabled) && (pinPort) == (port) ? (pin) : 0)
+
+// every pin in use on port, one term per pin (summed for the overlap check, OR'd for the masks)
+#define BOARD_PINS(port, op) ( \
+	BOARD_USE(1, BOARD_PICO_RX_PORT, BOARD_PICO_RX, port) op \
+	BOARD_USE(1, BOARD_PICO_TX_PORT, BOARD_PICO_TX, port) op \
+	BOARD_USE(1, BOARD_LED_PORT, BOARD_LED, port) op \
+	BOARD_USE(BOARD_BACK_SENS, BOARD_BACK_SENS_L_PORT, BOARD_BACK_SENS_L, port) op \
+	BOARD_USE(BOARD_BACK_SENS, BOARD_BACK_SENS_R_PORT, BOARD_BACK_SENS_R, port) op \
+	BOARD_USE(BOARD_HCSR04, BOARD_HCSR04_L_TRIG_PORT, BOARD_HCSR04_L_TRIG, port) op \
+	BOARD_USE(BOARD_HCSR04, BOARD_HCSR04_L_ECHO_PORT, BOARD_HCSR04_L_ECHO, port) op \
+	BOARD_USE(BOARD_HCSR04, BOARD_HCSR04_C_TRIG_PORT, BOARD_HCSR04_C_TRIG, port) op \
+	BOARD_USE(BOARD_HCSR04, BOARD_HCSR04_C_ECHO_PORT, BOARD_HCSR04_C_ECHO, port) op \
+	BOARD_USE(BOARD_HCSR04, BOARD_HCSR04_R_TRIG_PORT, BOARD_HCSR04_R_TRIG, port) op \
+	BOARD_USE(BOARD_HCSR04, BOARD_HCSR04_R_ECHO_PORT, BOARD_HCSR04_R_ECHO, port) op \
+	BOARD_USE(BOARD_SEN0427, BOARD_SEN0427_L_EN_PORT, BOARD_SEN0427_L_EN, port) op \
+	BOARD_USE(BOARD_SEN0427, BOARD_SEN0427_L_INT_PORT, BOARD_SEN0427_L_INT, port) op \
+	BOARD_USE(BOARD_SEN0427, BOARD_SEN0427_R_INT_PORT, BOARD_SEN0427_R_INT, port) op \
+	BOARD_USE(BOARD_GD03, BOARD_GD03_AIN_PORT, BOARD_GD03_AIN, port) op \
+	BOARD_USE(BOARD_BATTERY_DIV, BOARD_BATTERY_AIN_PORT, BOARD_BATTERY_AIN, port) op \
+	BOARD_USE(BOARD_I2C, BOARD_I2C_SDA_PORT, BOARD_I2C_SDA, port) op \
+	BOARD_USE(BOARD_I2C, BOARD_I2C_SCL_PORT, BOARD_I2C_SCL, port))
+
+// pins on each port that need its pin change ISR (main only builds the ones in use)
+#define BOARD_PCINT_PINS(port) ( \
+	BOARD_USE(BOARD_HCSR04, BOARD_HCSR04_L_ECHO_PORT, BOARD_HCSR04_L_ECHO, port) | \
+	BOARD_USE(BOARD_HCSR04, BOARD_HCSR04_C_ECHO_PORT, BOARD_HCSR04_C_ECHO, port) | \
+	BOARD_USE(BOARD_HCSR04, BOARD_HCSR04_R_ECHO_PORT, BOARD_HCSR04_R_ECHO, port) | \
+	BOARD_USE(BOARD_SEN0427, BOARD_SEN0427_L_INT_PORT, BOARD_SEN0427_L_INT, port) | \
+	BOARD_USE(BOARD_SEN0427, BOARD_SEN0427_R_INT_PORT, BOARD_SEN0427_R_INT, port))
+
+// pins in use on each port
+#define BOARD_PORTB_USED BOARD_PINS(BOARD_PORT_B, |)
+#define BOARD_PORTC_USED BOARD_PINS(BOARD_PORT_C, |)
+#define BOARD_PORTD_USED BOARD_PINS(BOARD_PORT_D, |)
+
+// the sum only matches the OR if no two pins share a bit
+_Static_assert(BOARD_PINS(BOARD_PORT_B, +) == BOARD_PORTB_USED, "board.h: two owners on the same port B pin");
+_Static_assert(BOARD_PINS(BOARD_PORT_C, +) == BOARD_PORTC_USED, "board.h: two owners on the same port C pin");
+_Static_assert(BOARD_PINS(BOARD_PORT_D, +) == BOARD_PORTD_USED, "board.h: two owners on the same port D pin");
+
+// fixed function pins
+_Static_assert(BOARD_PICO_RX_PORT == BOARD_PORT_D && BOARD_PICO_RX == BOARD_PIN(0)
+	&& BOARD_PICO_TX_PORT == BOARD_PORT_D && BOARD_PICO_TX == BOARD_PIN(1), "board.h: SCI0 is PD0/PD1");
+_Static_assert(BOARD_I2C_SDA_PORT == BOARD_PORT_C && BOARD_I2C_SDA == BOARD_PIN(4)
+	&& BOARD_I2C_SCL_PORT == BOARD_PORT_C && BOARD_I2C_SCL == BOARD_PIN(5), "board.h: TWI is PC4/PC5");
+_Static_assert(BOARD_BACK_SENS_L_PORT == BOARD_PORT_D && BOARD_BACK_SENS_L == BOARD_PIN(2),
+	"board.h: left bump switch has to be on INT0 (PD2)");
+_Static_assert(BOARD_BACK_SENS_R_PORT == BOARD_PORT_D && BOARD_BACK_SENS_R == BOARD_PIN(3),
+	"board.h: right bump switch has to be on INT1 (PD3)");
+_Static_assert(BOARD_HCSR04_C_ECHO_PORT == BOARD_PORT_B && BOARD_HCSR04_C_ECHO == BOARD_PIN(0),
+	"board.h: center echo is timed by input capture, it has to be on ICP1 (PB0)");
+_Static_assert(BOARD_GD03_AIN_PORT == BOARD_PORT_C && BOARD_GD03_AIN == BOARD_PIN(0),
+	"board.h: weight sensor is read on AtoD channel 0 (PC0)");
+_Static_assert(BOARD_BATTERY_AIN_PORT == BOARD_PORT_C && BOARD_BATTERY_AIN == BOARD_PIN(1),
+	"board.h: battery divider is read on AtoD channel 1 (PC1)");
+
+// pin change groups, main only has ISRs for PCINT0 (port B) and PCINT2 (port D)
+_Static_assert(!BOARD_PCINT_PINS(BOARD_PORT_C), "board.h: echo or IR interrupt on port C, there's no PCINT1 ISR");
+// PC6 is reset, and PB6/PB7 are the crystal
+_Static_assert(!(BOARD_PORTC_USED & BOARD_PIN(6)) && !(BOARD_PORTB_USED & (BOARD_PIN(6) | BOARD_PIN(7))),
+	"board.h: pin taken by reset or the crystal");
+// PB3-PB5 are MOSI/MISO/SCK for in-circuit programming, anything on them that drives the line (the IR
+// sensors' GPIO1) has to be unplugged or held off (CE low) while programming, there's no check for that
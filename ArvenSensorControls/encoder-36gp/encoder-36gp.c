@@ -9,6 +9,7 @@
  */
  #include <avr/io.h>
  #include "i2c.h"
+ #include "timer.h"
  #include "encoder-36gp.h"
  #include "../mcp23017/mcp23017.h"
  
@@ -20,10 +21,10 @@
 volatile unsigned char portA_byte = 0;
  // value last read from portB, used for motors 1-4
 volatile unsigned char portB_byte = 0;
-//TCNT value of when we started checking speed
-volatile unsigned int speedStart;
-// TCNT value of when we stopped checking speed
-volatile unsigned int speedEnd;
+// Timer_Now value of when we started checking speed
+volatile unsigned long speedStart;
+// Timer_Now value of when we stopped checking speed
+volatile unsigned long speedEnd;
 
 struct MotorPins {
 	MCP23017_BITADDR pin1;
@@ -122,7 +123,8 @@ unsigned char Encoder36GP_CheckDirection(Encoder36GP_Motor motor)
 unsigned long Encoder36GP_CheckSpeed(Encoder36GP_Motor motor)
 {
 	//TODO: set speed start/speed end somehow
-	return speedStart <= speedEnd ? speedEnd - speedStart : 65535 - speedStart + speedEnd;
+	// 32 bit timebase, so the difference is right across TCNT1 wraps
+	return speedEnd - speedStart;
 }
 
 
@@ -5,31 +5,229 @@
  * Author : Kia Skretteberg
  */
 #include <avr/io.h>
+#include <avr/pgmspace.h>
 #include <stdio.h>
 #include "atd.h"
 #include "gd03.h"
+#include "../board.h"
+
+// not on this robot, leave the whole driver out
+#if BOARD_GD03
 
 /************************************************************************/
 /* Local Definitions (private functions)                                */
 /************************************************************************/
 
+// start the detector over, empty with nothing in the window
+void detectReset(void);
+
+// one point on the calibration curve
+struct GD03_Point
+{
+	unsigned int Raw;   // 12 bit atodval
+	unsigned int Grams; // weight on the sensor at that reading
+};
+
+/************************************************************************/
+/* Global Variables                                                     */
+/************************************************************************/
+
+// where the weight is in the AtoD scan list, and the last result read from it
+unsigned char gd03ScanIndex = 0;
+struct AtoD_ScanResult gd03Result;
+
+// grams read when the scale was last tared, taken off every weight
+int gd03Tare = 0;
+
+// detector: last scan result it took, the window of tared grams and how full it is
+unsigned char detectSequence = 0;
+int detectWindow[GD03_SETTLE_SAMPLES];
+unsigned char detectPosition = 0;
+unsigned char detectCount = 0;
+long detectSum = 0;
+// something on the sensor, and the settled weight of the last event
+char detectLoaded = 0;
+int detectGrams = 0;
+
+// atodval to grams, raw ascending, straight lines in between
+// (the FSR's conductance is close to linear in force, so through the divider the grams climb slowly at
+// first and steeply near the top). Typical curve for 5V = 10N, replace with points measured on the robot
+const struct GD03_Point gd03Calibration[] PROGMEM = {
+	{    0,    0 },
+	{  410,   20 },
+	{  820,   45 },
+	{ 1230,   80 },
+	{ 1640,  125 },
+	{ 2050,  185 },
+	{ 2460,  265 },
+	{ 2870,  370 },
+	{ 3280,  510 },
+	{ 3690,  710 },
+	{ 4095, 1020 }
+};
+
+#define GD03_CALIBRATION_POINTS (sizeof(gd03Calibration) / sizeof(gd03Calibration[0]))
+
 /************************************************************************/
 /* Header Implementation                                                */
 /************************************************************************/
 
-void GD03_Init(void)
+void GD03_Init(unsigned char scanIndex)
 {
-	AtoD_Init(AtoD_Channel_0); // pin 23
+	gd03Result.Value = 0;
+	gd03Result.Time = 0;
+	gd03ScanIndex = scanIndex; // pin 23 (BOARD_GD03_AIN), converted by the scan ISR
+	gd03Tare = 0;
+	detectReset();
 }
 
 int GD03_CaptureAtoDVal(void)
 {
-    unsigned char AD_low = ADCL; // must be read first
-    unsigned char AD_high = ADCH;
-    unsigned int atodval = (AD_low + AD_high * 256);
-	return atodval;
+	// the scan keeps converting in the background, this is just the latest result (keeps the last one if there's none yet)
+	AtoD_ScanRead(gd03ScanIndex, &gd03Result);
+	// the oversampled 12 bits back down to what the frame has always carried
+	return gd03Result.Value >> 2;
+}
+
+int GD03_GetCaptureFine(void)
+{
+	return gd03Result.Value;
+}
+
+unsigned long GD03_GetCaptureTime(void)
+{
+	return gd03Result.Time;
+}
+
+unsigned int GD03_ToGrams(unsigned int atodval)
+{
+	unsigned char point;
+	unsigned int rawLow, rawHigh, gramsLow, gramsHigh;
+
+	// past the ends of the table, hold the end values
+	if(atodval <= pgm_read_word(&gd03Calibration[0].Raw))
+	{
+		return pgm_read_word(&gd03Calibration[0].Grams);
+	}
+	if(atodval >= pgm_read_word(&gd03Calibration[GD03_CALIBRATION_POINTS - 1].Raw))
+	{
+		return pgm_read_word(&gd03Calibration[GD03_CALIBRATION_POINTS - 1].Grams);
+	}
+
+	// first point above the reading, the one before it is at or below (a handful of points, no need to bisect)
+	for(point = 1; pgm_read_word(&gd03Calibration[point].Raw) <= atodval; ++point)
+		;
+	rawLow = pgm_read_word(&gd03Calibration[point - 1].Raw);
+	rawHigh = pgm_read_word(&gd03Calibration[point].Raw);
+	gramsLow = pgm_read_word(&gd03Calibration[point - 1].Grams);
+	gramsHigh = pgm_read_word(&gd03Calibration[point].Grams);
+
+	// along the line between them, one 16x16 multiply and a 32/16 divide (rounded)
+	return gramsLow + (unsigned int)(((unsigned long)(atodval - rawLow) * (gramsHigh - gramsLow)
+		+ (rawHigh - rawLow) / 2) / (rawHigh - rawLow));
+}
+
+int GD03_CaptureGrams(void)
+{
+	// same reading as the atodval, so the two always agree
+	return (int)GD03_ToGrams(gd03Result.Value) - gd03Tare;
+}
+
+void GD03_Tare(void)
+{
+	// the full 12 bits, the calibration table is on the same scale
+	GD03_CaptureAtoDVal();
+	gd03Tare = (int)GD03_ToGrams(gd03Result.Value);
+	// whatever is on it now is the new empty
+	detectReset();
+}
+
+GD03_EventType GD03_Update(struct GD03_Event * event)
+{
+	struct AtoD_ScanResult result;
+	int grams, low, high, average;
+	unsigned char i;
+
+	// only once per new result, the scan is a lot slower than the main loop
+	if(AtoD_ScanRead(gd03ScanIndex, &result) || result.Sequence == detectSequence)
+	{
+		return GD03_Event_None;
+	}
+	detectSequence = result.Sequence;
+
+	// moving average, the oldest sample drops out as the new one goes in
+	grams = (int)GD03_ToGrams(result.Value) - gd03Tare;
+	if(detectCount == GD03_SETTLE_SAMPLES)
+	{
+		detectSum -= detectWindow[detectPosition];
+	}
+	else
+	{
+		++detectCount;
+	}
+	detectWindow[detectPosition] = grams;
+	detectSum += grams;
+	if(++detectPosition == GD03_SETTLE_SAMPLES)
+	{
+		detectPosition = 0;
+	}
+	if(detectCount < GD03_SETTLE_SAMPLES)
+	{
+		return GD03_Event_None;
+	}
+
+	// still moving (being put down, picked up, or pills rattling about), wait for it to settle
+	low = high = detectWindow[0];
+	for(i = 1; i < GD03_SETTLE_SAMPLES; ++i)
+	{
+		if(detectWindow[i] < low)
+			low = detectWindow[i];
+		if(detectWindow[i] > high)
+			high = detectWindow[i];
+	}
+	if(high - low > GD03_SETTLE_BAND)
+	{
+		return GD03_Event_None;
+	}
+	average = (int)(detectSum / GD03_SETTLE_SAMPLES);
+
+	// thresholds far enough apart that a weight sitting near one doesn't flip back and forth
+	if(!detectLoaded && average >= GD03_PLACED_GRAMS)
+	{
+		detectLoaded = 1;
+		event->Type = GD03_Event_Placed;
+	}
+	else if(detectLoaded && average <= GD03_REMOVED_GRAMS)
+	{
+		detectLoaded = 0;
+		event->Type = GD03_Event_Removed;
+	}
+	else if(detectLoaded && (average - detectGrams >= GD03_CHANGE_GRAMS || detectGrams - average >= GD03_CHANGE_GRAMS))
+	{
+		event->Type = GD03_Event_Changed;
+	}
+	else
+	{
+		return GD03_Event_None;
+	}
+
+	detectGrams = average;
+	event->Grams = average;
+	event->Time = result.Time;
+	return event->Type;
 }
 
 /************************************************************************/
 /* Local  Implementation                                                */
 /************************************************************************/
+
+void detectReset(void)
+{
+	detectCount = 0;
+	detectPosition = 0;
+	detectSum = 0;
+	detectLoaded = 0;
+	detectGrams = 0;
+}
+
+#endif
@@ -1,14 +1,74 @@
 /*
  * gd03.h
  * GD03 Force Sensing Resistor (Weight Measurement)
- * Utilizes AtoD
+ * Utilizes the AtoD channel scan (atd.h)
  *
  * Created: 2023-02-21
  * Author : Kia Skretteberg
  */ 
 
-// Initialize AtoD channel 0 (pin 23)
-void GD03_Init(void);
+// Weight event detector (GD03_Update), on the tared grams
+#ifndef GD03_SETTLE_SAMPLES
+#define GD03_SETTLE_SAMPLES 8   // scan results averaged (one every ~16ms, so ~130ms)
+#endif
+#ifndef GD03_SETTLE_BAND
+#define GD03_SETTLE_BAND 4      // grams, settled once every sample in the window is within this of the rest
+#endif
+#ifndef GD03_PLACED_GRAMS
+#define GD03_PLACED_GRAMS 30    // settled at or above this with nothing on, something was placed
+#endif
+#ifndef GD03_REMOVED_GRAMS
+#define GD03_REMOVED_GRAMS 15   // settled at or below this with something on, it was lifted (below PLACED, hysteresis)
+#endif
+#ifndef GD03_CHANGE_GRAMS
+#define GD03_CHANGE_GRAMS (GD03_SETTLE_BAND + 1) // settled this far from the last event with something on, it changed (pills taken)
+#endif
+// a settled average can still wander by the band with nothing touched, a change has to be more than that
+_Static_assert(GD03_CHANGE_GRAMS > GD03_SETTLE_BAND, "gd03.h: GD03_CHANGE_GRAMS must be more than GD03_SETTLE_BAND");
 
-// Capture the atdoval from the channel
-int GD03_CaptureAtoDVal(void);
\ No newline at end of file
+// what the detector saw
+typedef enum
+{
+	GD03_Event_None = 0,
+	GD03_Event_Placed = 1,   // went from empty to loaded
+	GD03_Event_Removed = 2,  // went from loaded to empty
+	GD03_Event_Changed = 3   // still loaded, but settled at a different weight
+} GD03_EventType;
+
+struct GD03_Event
+{
+	GD03_EventType Type;
+	int Grams;               // settled weight (average over the window), less the tare
+	unsigned long Time;      // Timer_Now time of the sample it settled on
+};
+
+// AtoD channel (pin 23) and oversampling to put in the scan list, 4^2 samples for a 12 bit value
+#define GD03_CHANNEL AtoD_Channel_0
+#define GD03_OVERSAMPLE 2
+
+// Read the weight from entry scanIndex of the AtoD scan (AtoD_ScanInit)
+void GD03_Init(unsigned char scanIndex);
+
+// Capture the latest atodval from the scan (10 bits, 0-3FF, same scale as a single conversion),
+// never waits, 0 until the first one is in
+int GD03_CaptureAtoDVal(void);
+
+// The value GD03_CaptureAtoDVal last returned, before it's cut down to 10 bits (12 bits, 0-FFF)
+int GD03_GetCaptureFine(void);
+
+// Timer_Now time the value GD03_CaptureAtoDVal last returned was sampled (its last oversample)
+unsigned long GD03_GetCaptureTime(void);
+
+// Convert a 12 bit atodval (GD03_GetCaptureFine) to grams through the calibration table (in flash), integer math only
+unsigned int GD03_ToGrams(unsigned int atodval);
+
+// The value GD03_CaptureAtoDVal last returned as grams, less the tare (can go negative)
+int GD03_CaptureGrams(void);
+
+// Take whatever is on the sensor right now as the new zero for GD03_CaptureGrams
+// (the detector starts over, empty)
+void GD03_Tare(void);
+
+// Run any new scan results through the detector, call every main loop pass (never waits)
+// Returns the event and fills it in, GD03_Event_None (event untouched) if nothing happened
+GD03_EventType GD03_Update(struct GD03_Event * event);
\ No newline at end of file
@@ -6,33 +6,95 @@
  */
 #define F_CPU 16E6 // with external xtal enabled, and clock div/8, bus == 2MHz
 #include <avr/io.h>
-#include <stdio.h>
 #include <util/delay.h> // have to add, has delay implementation (requires F_CPU to be defined)
+#include <util/atomic.h>
 #include "hc-sr04.h"
 #include "sci.h"
- 
+#include "timer.h"
+#include "trace.h"
+#include "pcint.h"
+
+// not on this robot, leave the whole driver out
+#if BOARD_HCSR04
+
 /************************************************************************/
 /* Local Definitions (private functions)                                */
 /************************************************************************/
- 
-// Toggle the specified pin low for 2us, then high for 10us, then back to low, in order to send out a pulse
-int trigger(HCSR04_Device device);
- 
-// Wait for the echo signal to go low from the specified pin
-long waitForEcho(HCSR04_Device device);
- 
- 
+
+// Toggle the specified device's trigger pin low for 2us, then high for 10us, then back to low, in order to send out a pulse
+void trigger(HCSR04_Device device);
+
+// The pulse itself, on pin of port
+void pulse(volatile unsigned char * port, unsigned char pin);
+
+// Mark the device as measuring, tag it with a new slot and send out its pulse
+void firePing(HCSR04_Device device);
+
+// Start or finish timing the device's echo on an edge of its echo pin (from the pin change ISR)
+void echoEdge(HCSR04_Device device, char high);
+
+// Pin change handlers for each device's echo pin, see PCINT_Handler
+void echoEdgeL(unsigned char changed, unsigned char level);
+void echoEdgeC(unsigned char changed, unsigned char level);
+void echoEdgeR(unsigned char changed, unsigned char level);
+
+// Convert the echo width, in timer counts (0.5us), into the value reported for a measurement
+long countsToDuration(long counts);
+
+// Record the end of the device's echo (at Timer_Now time end), store the result and free the device
+void completeMeasurement(HCSR04_Device device, unsigned long end);
+
+// Store a result for the device, free it and stop the deadline if nothing else is measuring
+void finishMeasurement(HCSR04_Device device, HCSR04_Status status, long duration);
+
+// Run by the output compare B ISR while the scheduler is on: close the last slot and fire the next one
+void schedulerSlot(void);
+
+// 1 if the device's echo line is high right now
+char echoLine(HCSR04_Device device);
+
+// slots are running, for the scheduler or a one-shot ping
+#define SLOTS_RUNNING (schedulerMask || oneShotMask)
+
+
 /************************************************************************/
 /* Global Variables                                                     */
 /************************************************************************/
 
-volatile long echoTimeStart = 0;
-volatile long echoTimeEnd = 0;
-volatile HCSR04_Device activeDevice = HCSR04_None;
+// Timer_Now times of each device's echo edges (32 bits, so a 38ms echo can't wrap)
+volatile unsigned long echoTimeStart[HCSR04_DEVICE_COUNT];
+// Timer_Now time each device was last pinged
+volatile unsigned long fireTime[HCSR04_DEVICE_COUNT];
+// devices with a ping out, HCSR04_MASK bits
+volatile unsigned char activeMask = 0;
+// echo pin level of each measuring device as of the last pin change, HCSR04_MASK bits
+volatile unsigned char echoHigh = 0;
+// where each device is in its measurement, and the last result it completed
+volatile HCSR04_Status deviceStatus[HCSR04_DEVICE_COUNT] = {HCSR04_Status_Idle, HCSR04_Status_Idle, HCSR04_Status_Idle};
+volatile long deviceDuration[HCSR04_DEVICE_COUNT];
+// slot each device's last ping went out in
+volatile unsigned char deviceSlot[HCSR04_DEVICE_COUNT];
+// slot of the most recent ping from any device, the only window an echo is accepted in
+volatile unsigned char currentSlot = 0;
+// optional completion notification, called from the ISR
+HCSR04_Callback completionCallback = 0;
+// 1 when the center echo is timed by the Timer1 input capture unit instead of the pin change ISR
+volatile char centerInputCapture = 0;
+// output compare B steps left before a single ping gives up on its echo
+volatile unsigned char timeoutStepsLeft = 0;
+// devices the scheduler takes turns on (0 = scheduler off), and the guard between slots
+volatile unsigned char schedulerMask = 0;
+volatile unsigned int schedulerGuard = HCSR04_DEFAULT_GUARD;
+// devices waiting on a one-shot slot (HCSR04_RequestPing)
+volatile unsigned char oneShotMask = 0;
+// mm per duration unit (one way us) at the current temperature, 16.16 fixed point
+unsigned int mmScale = 0;
+// device whose slot came up last
+volatile HCSR04_Device schedulerDevice = HCSR04_R;
+// adaptive rate, timer counts to wait after an echo before the next slot (0 = fixed guard only)
+volatile unsigned int schedulerSettle = 0;
 
-volatile char buff[200];
 
- 
 /************************************************************************/
 /* Header Implementation                                                */
 /************************************************************************/
@@ -49,26 +111,26 @@ void HCSR04_InitDevice(HCSR04_Device device)
 	switch(device)
 	{
 		case HCSR04_L:
-			DDRD |= HCSR04_L_Trig; //output
-			DDRD &= ~HCSR04_L_Echo; //input
-			
-			PCMSK2 |= HCSR04_L_Echo; // turn on PCINT22 pin mask (enable interrupts) (12.2.6)
-			PCICR |= 0b00000100; // turn on interrupts for group 2 (12.2.4)
+			BOARD_DDR_REG(BOARD_HCSR04_L_TRIG_PORT) |= HCSR04_L_Trig; //output
+			BOARD_DDR_REG(BOARD_HCSR04_L_ECHO_PORT) &= ~HCSR04_L_Echo; //input
+
+			PCINT_Register((PCINT_Port)BOARD_HCSR04_L_ECHO_PORT, HCSR04_L_Echo, echoEdgeL);
+			PCINT_Enable((PCINT_Port)BOARD_HCSR04_L_ECHO_PORT, HCSR04_L_Echo);
 			break;
 		case HCSR04_C:
-			DDRD |= HCSR04_C_Trig; //output
-			DDRB &= ~HCSR04_C_Echo; //input
-			
-			PCMSK0 |= HCSR04_C_Echo; // turn on PCINT0 pin mask (enable interrupts) (12.2.8)
-			PCICR |= 0b00000001; // turn on interrupts for group 0 (12.2.4)
+			BOARD_DDR_REG(BOARD_HCSR04_C_TRIG_PORT) |= HCSR04_C_Trig; //output
+			BOARD_DDR_REG(BOARD_HCSR04_C_ECHO_PORT) &= ~HCSR04_C_Echo; //input
+
+			PCINT_Register((PCINT_Port)BOARD_HCSR04_C_ECHO_PORT, HCSR04_C_Echo, echoEdgeC);
+			PCINT_Enable((PCINT_Port)BOARD_HCSR04_C_ECHO_PORT, HCSR04_C_Echo);
 			break;
 		case HCSR04_R:
-			DDRB |= HCSR04_R_Trig; //output
-			DDRB &= ~HCSR04_R_Echo; //input
-			
-			PCMSK0 |= HCSR04_R_Echo; // turn on PCINT2 pin mask (enable interrupts) (12.2.8)
-			PCICR |= 0b00000001; // turn on interrupts for group 0 (12.2.4)
-			break; 
+			BOARD_DDR_REG(BOARD_HCSR04_R_TRIG_PORT) |= HCSR04_R_Trig; //output
+			BOARD_DDR_REG(BOARD_HCSR04_R_ECHO_PORT) &= ~HCSR04_R_Echo; //input
+
+			PCINT_Register((PCINT_Port)BOARD_HCSR04_R_ECHO_PORT, HCSR04_R_Echo, echoEdgeR);
+			PCINT_Enable((PCINT_Port)BOARD_HCSR04_R_ECHO_PORT, HCSR04_R_Echo);
+			break;
 		default:
 			break;
 	}
@@ -77,143 +139,498 @@ void HCSR04_InitDevice(HCSR04_Device device)
 long HCSR04_GetEchoDuration(HCSR04_Device device)
 {
 	long duration = 0;
-	
-	echoTimeStart = 0;
-	echoTimeEnd = 0;
-	if(trigger(device))
+
+	if(HCSR04_StartPing(device))
+	{
+		// wait for the ISR to finish the measurement
+		while(HCSR04_PollEcho(device, &duration) == HCSR04_Status_Pending);
+	}
+	return duration;
+}
+
+int HCSR04_StartPing(HCSR04_Device device)
+{
+	// the scheduler owns the sensors while it runs, and one ping at a time otherwise
+	if(device >= HCSR04_DEVICE_COUNT || SLOTS_RUNNING || activeMask)
+	{
+		return 0;
+	}
+
+	// arm the deadline on output compare B, so a missing echo can't hold the sensor slot forever
+	// 16 bit timer registers share the TEMP byte with the timer ISRs, don't let one in between
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		timeoutStepsLeft = HCSR04_TIMEOUT_STEPS;
+		OCR1B = TCNT1 + HCSR04_TIMEOUT_STEP;
+		TIFR1 = (1 << OCF1B);
+		TIMSK1 |= (1 << OCIE1B);
+	}
+	firePing(device);
+	return 1;
+}
+
+HCSR04_Status HCSR04_PollEcho(HCSR04_Device device, long * duration)
+{
+	struct HCSR04_Sample sample;
+	HCSR04_Status status = HCSR04_PollSample(device, &sample);
+
+	if(status != HCSR04_Status_Pending && status != HCSR04_Status_Idle)
 	{
-		duration = waitForEcho(device);
+		*duration = sample.Duration;
 	}
-	return duration / 2; // divide 2 in order to convert to us
+	return status;
 }
 
-void HCSR04_ISR()
+HCSR04_Status HCSR04_PollSample(HCSR04_Device device, struct HCSR04_Sample * sample)
 {
-	
-	// Only perform the check if there's an active device
-	if(activeDevice != HCSR04_None)
+	HCSR04_Status status;
+
+	if(device >= HCSR04_DEVICE_COUNT)
+	{
+		return HCSR04_Status_Idle;
+	}
+
+	// hand over the result once, then the device is free for the next ping
+	// the scheduler ISR can re-ping the device at any time, so the status and result go together
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
 	{
-		PORTC ^= 0b00000100;
-		int condition = 0;
-		// determine the high condition for the active device
-		switch(activeDevice)
+		status = deviceStatus[device];
+		if(status != HCSR04_Status_Pending && status != HCSR04_Status_Idle)
 		{
-			case HCSR04_L:
-			condition = PIND & HCSR04_L_Echo;			
-			break;
-			case HCSR04_C:
-			condition = PINB & HCSR04_C_Echo;
-			break;
-			case HCSR04_R:
-			condition = PINB & HCSR04_R_Echo;
-			break;
-		default:
-			break;
+			sample->Duration = deviceDuration[device];
+			sample->FireTime = fireTime[device];
+			sample->Slot = deviceSlot[device];
+			deviceStatus[device] = HCSR04_Status_Idle;
+		}
+	}
+	return status;
+}
+
+void HCSR04_SetCallback(HCSR04_Callback callback)
+{
+	completionCallback = callback;
+}
+
+int HCSR04_StartScheduler(unsigned char devices, unsigned int guard)
+{
+	// the slot ISR reads all of this, and 16 bit timer registers share the TEMP byte with the timer ISRs
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		// a single ping still out would get its deadline taken over, let it finish first
+		if(!SLOTS_RUNNING && activeMask)
+		{
+			return -1;
+		}
+
+		char running = SLOTS_RUNNING;
+
+		schedulerGuard = guard;
+		schedulerMask = devices & (HCSR04_MASK(HCSR04_L) | HCSR04_MASK(HCSR04_C) | HCSR04_MASK(HCSR04_R));
+
+		if(SLOTS_RUNNING)
+		{
+			// first slot right away (slots already running just carry on), output compare B paces the rest
+			if(!running)
+			{
+				timeoutStepsLeft = 0;
+				OCR1B = TCNT1 + HCSR04_SLOT_LEAD;
+				TIFR1 = (1 << OCF1B);
+				TIMSK1 |= (1 << OCIE1B);
+			}
 		}
-		
-		// When the echo starts, track current TCNT value
-		if(condition)
+		else if(activeMask)
 		{
-			echoTimeStart = TCNT1;
+			// no more slots to close it, a ping still out gets a full single ping deadline from here
+			// (the compare could otherwise be due any moment and cut it off)
+			timeoutStepsLeft = HCSR04_TIMEOUT_STEPS;
+			OCR1B = TCNT1 + HCSR04_TIMEOUT_STEP;
+			TIFR1 = (1 << OCF1B);
 		}
-		// When echo ends, track the new TCNT value and indicate no device is active
 		else
 		{
-			echoTimeEnd = TCNT1;
-			activeDevice = HCSR04_None;
+			TIMSK1 &= ~(1 << OCIE1B);
+		}
+	}
+	return 0;
+}
+
+int HCSR04_RequestPing(unsigned char devices)
+{
+	devices &= HCSR04_MASK(HCSR04_L) | HCSR04_MASK(HCSR04_C) | HCSR04_MASK(HCSR04_R);
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		// same as starting the scheduler, a single ping still out has to finish first
+		if(!SLOTS_RUNNING && activeMask)
+		{
+			return -1;
 		}
+		if(!devices)
+		{
+			return 0;
+		}
+
+		if(!SLOTS_RUNNING)
+		{
+			timeoutStepsLeft = 0;
+			OCR1B = TCNT1 + HCSR04_SLOT_LEAD;
+			TIFR1 = (1 << OCF1B);
+			TIMSK1 |= (1 << OCIE1B);
+		}
+		oneShotMask |= devices;
+	}
+	return 0;
+}
+
+void HCSR04_StopScheduler(void)
+{
+	HCSR04_StartScheduler(0, schedulerGuard);
+}
+
+void HCSR04_SetAdaptiveRate(unsigned int settle)
+{
+	schedulerSettle = settle;
+}
+
+void HCSR04_SetTemperature(int eighths)
+{
+	// speed of sound in mm/s, 0.606 m/s per degree is 75.75 mm/s per 1/8 degree
+	unsigned long speed = 331300 + (303L * eighths) / 4;
+
+	// mm/s * 2^16 / 10^6 for mm per us in 16.16, reduced to * 4096 / 62500 to stay within 32 bits
+	mmScale = (unsigned int)((speed * 4096 + 31250) / 62500);
+}
+
+unsigned int HCSR04_DurationToMm(long duration)
+{
+	unsigned long mm;
+
+	if(duration == HCSR04_NO_ECHO || duration < 0)
+	{
+		return HCSR04_NO_ECHO_MM;
+	}
+
+	// nothing set yet, use the default temperature
+	if(!mmScale)
+	{
+		HCSR04_SetTemperature(HCSR04_DEFAULT_TEMPERATURE);
 	}
+
+	// duration is the one way time in us, round to the nearest mm
+	mm = ((unsigned long)duration * mmScale + 0x8000) >> 16;
+	// keep clear of the no echo value
+	return mm >= HCSR04_NO_ECHO_MM ? HCSR04_NO_ECHO_MM - 1 : (unsigned int)mm;
 }
 
+void HCSR04_SetInputCapture(char enable)
+{
+	if(enable)
+	{
+		PCINT_Disable((PCINT_Port)BOARD_HCSR04_C_ECHO_PORT, HCSR04_C_Echo); // PB0 edges come through ICP1 now, not PCINT0
+		TCCR1B |= (1 << ICNC1) | (1 << ICES1); // noise canceler on, start on the rising edge (16.11.2)
+		TIFR1 = (1 << ICF1); // clear anything already latched
+		TIMSK1 |= (1 << ICIE1); // input capture interrupt on, leaves output compare A alone (16.11.8)
+		centerInputCapture = 1;
+	}
+	else
+	{
+		centerInputCapture = 0;
+		TIMSK1 &= ~(1 << ICIE1);
+		TCCR1B &= ~((1 << ICNC1) | (1 << ICES1));
+		PCINT_Enable((PCINT_Port)BOARD_HCSR04_C_ECHO_PORT, HCSR04_C_Echo);
+	}
+}
+
+void HCSR04_CaptureISR(void)
+{
+	unsigned int captured = ICR1;
+
+	// an edge we weren't waiting on (eg. a late echo), nothing to record, just rearm for a rising edge
+	if(!(activeMask & HCSR04_MASK(HCSR04_C)))
+	{
+		TCCR1B |= (1 << ICES1);
+		TIFR1 = (1 << ICF1);
+		return;
+	}
+
+	if(TCCR1B & (1 << ICES1))
+	{
+		// started after another sensor has pinged, so it could well be hearing that ping
+		if(SLOTS_RUNNING && deviceSlot[HCSR04_C] != currentSlot)
+		{
+			finishMeasurement(HCSR04_C, HCSR04_Status_Crosstalk, HCSR04_NO_ECHO);
+			TIFR1 = (1 << ICF1);
+			return;
+		}
+		// echo started, now wait for it to end
+		echoTimeStart[HCSR04_C] = Timer_Extend(captured);
+		TRACE(Trace_EchoStart, HCSR04_C);
+		TCCR1B &= ~(1 << ICES1);
+		// changing the edge can set the flag on its own, so clear it (16.6.3)
+		TIFR1 = (1 << ICF1);
+	}
+	else
+	{
+		// echo ended, back to rising for the next ping
+		TCCR1B |= (1 << ICES1);
+		TIFR1 = (1 << ICF1);
+		completeMeasurement(HCSR04_C, Timer_Extend(captured));
+	}
+}
+
+void HCSR04_TimeoutISR(void)
+{
+	// the scheduler uses output compare B to pace its slots instead
+	if(SLOTS_RUNNING)
+	{
+		schedulerSlot();
+		return;
+	}
+
+	// a step down, if there's more to go push the compare out again
+	if(timeoutStepsLeft && --timeoutStepsLeft)
+	{
+		OCR1B += HCSR04_TIMEOUT_STEP;
+		return;
+	}
+
+	// no echo, or it never ended, for whatever is still out
+	for(HCSR04_Device device = HCSR04_L; device < HCSR04_DEVICE_COUNT; ++device)
+	{
+		if(activeMask & HCSR04_MASK(device))
+		{
+			finishMeasurement(device, HCSR04_Status_NoEcho, HCSR04_NO_ECHO);
+		}
+	}
+	TIMSK1 &= ~(1 << OCIE1B);
+}
 
 /************************************************************************/
 /* Local  Implementation                                                */
 /************************************************************************/
 
-int trigger(HCSR04_Device device)
+void firePing(HCSR04_Device device)
+{
+	unsigned char mask = HCSR04_MASK(device);
+
+	// a new slot opens, anything still out from an earlier one can no longer be trusted
+	deviceSlot[device] = ++currentSlot;
+	deviceStatus[device] = HCSR04_Status_Pending;
+	fireTime[device] = Timer_Now();
+	// in case the echo line is already up and the rising edge never shows
+	echoTimeStart[device] = fireTime[device];
+	echoHigh &= ~mask;
+	activeMask |= mask;
+
+	if(device == HCSR04_C && centerInputCapture)
+	{
+		// arm the capture unit for the rising edge, and throw away anything it latched since
+		TCCR1B |= (1 << ICES1);
+		TIFR1 = (1 << ICF1);
+	}
+	TRACE(Trace_PingFire, device | (deviceSlot[device] << 8));
+	trigger(device);
+}
+
+void trigger(HCSR04_Device device)
+{
+	// Determine which pin needs to be toggled based on the device
+	switch(device)
+	{
+		case HCSR04_L:
+			pulse(&BOARD_PORT_REG(BOARD_HCSR04_L_TRIG_PORT), HCSR04_L_Trig);
+			break;
+		case HCSR04_C:
+			pulse(&BOARD_PORT_REG(BOARD_HCSR04_C_TRIG_PORT), HCSR04_C_Trig);
+			break;
+		case HCSR04_R:
+			pulse(&BOARD_PORT_REG(BOARD_HCSR04_R_TRIG_PORT), HCSR04_R_Trig);
+			break;
+		default:
+			break;
+	}
+}
+
+void pulse(volatile unsigned char * port, unsigned char pin)
+{
+	// set pin low for 2 us to ensure we're starting with a fresh pulse
+	*port &= ~pin;
+	_delay_us(2);
+	// set the pin high for a minimum of 10us to ensure the 8 pulses are sent, according to the datasheet (see header file)
+	*port |= pin;
+	_delay_us(10);
+	*port &= ~pin;
+}
+
+void echoEdge(HCSR04_Device device, char high)
 {
-	// ensure there is no active device
-	if(activeDevice == HCSR04_None)
+	unsigned char mask = HCSR04_MASK(device);
+
+	// not measuring (eg. a late echo from a ping that already finished)
+	if(!(activeMask & mask))
+	{
+		return;
+	}
+
+	if(high)
 	{
-		int pin;
-		
-		// set the device to be active
-		activeDevice = device;
-		
-		// Determine which pin needs to be toggled based on the device
-		switch(activeDevice)
+		// started after another sensor has pinged, so it could well be hearing that ping
+		if(SLOTS_RUNNING && deviceSlot[device] != currentSlot)
 		{
-			case HCSR04_L:
-				pin = HCSR04_L_Trig;
-				break;
-			case HCSR04_C:
-				pin = HCSR04_C_Trig;
-				break;
-			case HCSR04_R:
-				pin = HCSR04_R_Trig;
-				break;
-			default:
-				break;
+			finishMeasurement(device, HCSR04_Status_Crosstalk, HCSR04_NO_ECHO);
+			return;
 		}
-		switch(activeDevice)
+		// When the echo starts, track the current time
+		echoHigh |= mask;
+		echoTimeStart[device] = Timer_Now();
+		TRACE(Trace_EchoStart, device);
+	}
+	else if(echoHigh & mask)
+	{
+		// When echo ends, store the result and indicate the device is free
+		// (only after a rising edge since the ping, a line that was already up tells us nothing)
+		echoHigh &= ~mask;
+		completeMeasurement(device, Timer_Now());
+	}
+}
+
+void echoEdgeL(unsigned char changed, unsigned char level)
+{
+	(void)changed; // only this pin is registered, so it's always the one that changed
+	echoEdge(HCSR04_L, (level & HCSR04_L_Echo) != 0);
+}
+
+void echoEdgeC(unsigned char changed, unsigned char level)
+{
+	(void)changed; // only this pin is registered, so it's always the one that changed
+	echoEdge(HCSR04_C, (level & HCSR04_C_Echo) != 0);
+}
+
+void echoEdgeR(unsigned char changed, unsigned char level)
+{
+	(void)changed; // only this pin is registered, so it's always the one that changed
+	echoEdge(HCSR04_R, (level & HCSR04_R_Echo) != 0);
+}
+
+long countsToDuration(long counts)
+{
+	// counts are 0.5us, so divide by 2 to get 1us units, then by 2 again (what the frame has always carried)
+	return (counts / 2) / 2;
+}
+
+void completeMeasurement(HCSR04_Device device, unsigned long end)
+{
+	// ran past its own slot, nothing came back inside the window (the slot ISR normally gets there first)
+	if(SLOTS_RUNNING && deviceSlot[device] != currentSlot)
+	{
+		finishMeasurement(device, HCSR04_Status_NoEcho, HCSR04_NO_ECHO);
+		return;
+	}
+
+	// adaptive rate, the echo is back so the next slot only has to wait out the settle time
+	// (only ever brought in, a settle longer than what's left of the guard leaves the slot alone)
+	if(SLOTS_RUNNING && schedulerSettle)
+	{
+		unsigned int now = TCNT1;
+
+		if((unsigned int)(OCR1B - now) > schedulerSettle)
 		{
-			case HCSR04_L:
-			case HCSR04_C:
-				// set pin low for 2 us to ensure we're starting with a fresh pulse
-				PORTD &= ~pin;
-				_delay_us(2);		
-				// set the pin high for a minimum of 10us to ensure the 8 pulses are sent, according to the datasheet (see header file)
-				PORTD |= pin;
-				_delay_us(10); 
-				PORTD &= ~pin;
-				break;
-			case HCSR04_R:
-				// set pin low for 2 us to ensure we're starting with a fresh pulse
-				PORTB &= ~pin;
-				_delay_us(2);				
-				// set the pin high for a minimum of 10us to ensure the 8 pulses are sent, according to the datasheet (see header file)
-				PORTB |= pin;
-				_delay_us(10);
-				PORTB &= ~pin;
-				break;
-			default:
-				break;			
+			OCR1B = now + schedulerSettle;
+			TIFR1 = (1 << OCF1B);
 		}
+	}
+
+	// both ends are on the 32 bit timebase, so a plain difference is right even across a TCNT1 wrap
+	finishMeasurement(device, HCSR04_Status_Ready, countsToDuration(end - echoTimeStart[device]));
+}
 
-		
-		// successful trigger
-		return 1;
+void finishMeasurement(HCSR04_Device device, HCSR04_Status status, long duration)
+{
+	unsigned char mask = HCSR04_MASK(device);
+
+	activeMask &= ~mask;
+	echoHigh &= ~mask;
+	// done with this ping one way or the other, a single ping's deadline isn't needed
+	if(!SLOTS_RUNNING && !activeMask)
+	{
+		TIMSK1 &= ~(1 << OCIE1B);
+		timeoutStepsLeft = 0;
+	}
+
+	deviceDuration[device] = duration;
+	deviceStatus[device] = status;
+	TRACE(Trace_PingDone, device | (status << 8));
+
+	if(completionCallback)
+	{
+		completionCallback(device, duration);
 	}
-	
-	// there was an active device so we couldn't trigger
-	return 0;
 }
 
-long waitForEcho(HCSR04_Device device)
+void schedulerSlot(void)
 {
-	char buff[20];
-	long diff;
-	//DDRC |= 0b00000100;
-	// ensure this is the active device before waiting for echo
-	if(activeDevice == device)
+	HCSR04_Device device = schedulerDevice;
+	unsigned char due;
+
+	OCR1B += schedulerGuard;
+
+	// the last slot is over, whatever is still out had nothing come back inside its window
+	// (a clear path holds the echo for 38ms, far longer than a slot, so this is what reports it)
+	for(HCSR04_Device stale = HCSR04_L; stale < HCSR04_DEVICE_COUNT; ++stale)
 	{
-		// wait for the device to no longer be active, meaning the echo finished
-		while(activeDevice == device);
-		if( echoTimeEnd >= echoTimeStart){
-			diff = echoTimeEnd - echoTimeStart;
-		} else{
-			diff = 65535 - echoTimeStart + echoTimeEnd;
+		if(activeMask & HCSR04_MASK(stale))
+		{
+			finishMeasurement(stale, HCSR04_Status_NoEcho, HCSR04_NO_ECHO);
+		}
+	}
+
+	// one-shots go first, then the scheduler's devices in turn
+	if(oneShotMask)
+	{
+		for(device = HCSR04_L; !(oneShotMask & HCSR04_MASK(device)); ++device);
+		oneShotMask &= ~HCSR04_MASK(device);
+	}
+	else if(schedulerMask)
+	{
+		do
+		{
+			device = device == HCSR04_R ? HCSR04_L : device + 1;
+		} while(!(schedulerMask & HCSR04_MASK(device)));
+		schedulerDevice = device;
+	}
+	else
+	{
+		// only one-shots were running and they're all done (the last one's window just closed)
+		TIMSK1 &= ~(1 << OCIE1B);
+		return;
+	}
+	due = HCSR04_MASK(device);
+
+	// still holding its echo line from its last ping, it misses this slot (a one-shot waits for the next)
+	if(echoLine(device))
+	{
+		if(!(schedulerMask & due))
+		{
+			oneShotMask |= due;
 		}
-		//PORTC ^= 0b00000100;
-		sprintf(buff, "\n%li", echoTimeEnd);
-		//SCI0_TxString(buff);
-		sprintf(buff, "\n%li", echoTimeStart);
-		//SCI0_TxString(buff);
-		sprintf(buff, "\n%li", diff);
-		//SCI0_TxString(buff);
-		return (diff)/2; // actual value is in 0.5us, so need to divide by 2 to get 1us units
-	}
-	
-	// active device is not this device, return invalid duration
-	return -1;
+		return;
+	}
+	firePing(device);
 }
+
+char echoLine(HCSR04_Device device)
+{
+	switch(device)
+	{
+		case HCSR04_L:
+			return (BOARD_PIN_REG(BOARD_HCSR04_L_ECHO_PORT) & HCSR04_L_Echo) != 0;
+		case HCSR04_C:
+			return (BOARD_PIN_REG(BOARD_HCSR04_C_ECHO_PORT) & HCSR04_C_Echo) != 0;
+		case HCSR04_R:
+			return (BOARD_PIN_REG(BOARD_HCSR04_R_ECHO_PORT) & HCSR04_R_Echo) != 0;
+		default:
+			return 0;
+	}
+}
+
+#endif
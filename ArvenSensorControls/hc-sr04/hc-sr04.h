@@ -8,12 +8,15 @@
  * Operating characteristics retrieved from https://cdn.sparkfun.com/datasheets/Sensors/Proximity/HCSR04.pdf
  */ 
 
-#define HCSR04_L_Trig 0b00100000 // PORTD
-#define HCSR04_L_Echo 0b01000000 // PORTD
-#define HCSR04_C_Trig 0b10000000 // PORTD
-#define HCSR04_C_Echo 0b00000001 // PORTB
-#define HCSR04_R_Trig 0b00000010 // PORTB
-#define HCSR04_R_Echo 0b00000100 // PORTB
+#include "../board.h"
+
+// pins come from the board profile, see board.h for the ports
+#define HCSR04_L_Trig BOARD_HCSR04_L_TRIG
+#define HCSR04_L_Echo BOARD_HCSR04_L_ECHO
+#define HCSR04_C_Trig BOARD_HCSR04_C_TRIG
+#define HCSR04_C_Echo BOARD_HCSR04_C_ECHO
+#define HCSR04_R_Trig BOARD_HCSR04_R_TRIG
+#define HCSR04_R_Echo BOARD_HCSR04_R_ECHO
 
 typedef enum
 {
@@ -24,6 +27,55 @@ typedef enum
 	HCSR04_None = 10
 } HCSR04_Device;
 
+#define HCSR04_DEVICE_COUNT 3
+
+// bit for a device in a set of devices (eg. HCSR04_StartScheduler)
+#define HCSR04_MASK(device) (1 << (device))
+
+typedef enum
+{
+	HCSR04_Status_Idle = 0,    // no measurement started, or the result was already collected
+	HCSR04_Status_Pending = 1, // pinged, waiting on the echo
+	HCSR04_Status_Ready = 2,   // echo finished, result waiting to be collected
+	HCSR04_Status_NoEcho = 3,  // no echo before the deadline, duration is HCSR04_NO_ECHO
+	HCSR04_Status_Crosstalk = 4 // echo started in another sensor's slot, rejected, duration is HCSR04_NO_ECHO
+} HCSR04_Status;
+
+// A completed measurement, along with when and in which slot its ping went out
+struct HCSR04_Sample {
+	long Duration;           // same units as HCSR04_GetEchoDuration, HCSR04_NO_ECHO if none
+	unsigned long FireTime;  // Timer_Now time the ping went out
+	unsigned char Slot;      // firing slot, counts up by one for every ping from any device
+};
+
+// Default time between scheduled pings (timer counts, 0.5us), 12ms leaves room for ~2m of range
+// before the next sensor fires, anything further comes back as HCSR04_NO_ECHO
+#define HCSR04_DEFAULT_GUARD 24000
+
+// Default settle time for the adaptive rate (timer counts, 0.5us), 2ms for the last echo's ringing to die out
+#define HCSR04_DEFAULT_SETTLE 4000
+
+// Per ping deadline, counted on Timer1 output compare B in steps (each step must fit in 16 bits of TCNT1)
+// The sensor holds echo high for 38ms when nothing is in range, so 2 x 20ms leaves some margin
+#define HCSR04_TIMEOUT_STEP   40000 // timer counts (0.5us) per step, 20ms
+#define HCSR04_TIMEOUT_STEPS  2
+
+// Lead on the scheduler's first slot (timer counts, 0.5us), enough to still be ahead of TCNT1 when the
+// compare is written (the flag can't be set by hand, and a compare already passed waits out a whole wrap)
+#define HCSR04_SLOT_LEAD      400
+
+// Duration reported when a ping times out (no echo / out of range), larger than any real measurement
+#define HCSR04_NO_ECHO 0xFFFF
+
+// HCSR04_DurationToMm result for HCSR04_NO_ECHO
+#define HCSR04_NO_ECHO_MM 0xFFFF
+
+// Air temperature used for the mm conversion until HCSR04_SetTemperature is called, 1/8 degrees C (20C)
+#define HCSR04_DEFAULT_TEMPERATURE 160
+
+// Called from the ISR when a device finishes a measurement, keep it short
+typedef void (*HCSR04_Callback)(HCSR04_Device device, long duration);
+
 // Initialize all HCSR04 devices
 void HCSR04_InitAll(void);
 
@@ -31,7 +83,66 @@ void HCSR04_InitAll(void);
 void HCSR04_InitDevice(HCSR04_Device device);
 
 // Get the current duration of the echo'd signal from the specified device, in us
+// Blocks until the echo completes or times out (HCSR04_NO_ECHO), see HCSR04_StartPing for the non-blocking version
 long HCSR04_GetEchoDuration(HCSR04_Device device);
 
-// ISR for calculating the time that the echo pin is high for the active device
-void HCSR04_ISR();
+// Send out a ping on the specified device and return straight away, the ISR finishes the measurement
+// Returns 1 if the ping went out, 0 if another device is still measuring or the scheduler is running
+int HCSR04_StartPing(HCSR04_Device device);
+
+// Check on a ping started with HCSR04_StartPing. When Ready or NoEcho, duration is filled in (same units as
+// HCSR04_GetEchoDuration, HCSR04_NO_ECHO on timeout) and the device goes back to Idle, so each result is
+// only returned once
+HCSR04_Status HCSR04_PollEcho(HCSR04_Device device, long * duration);
+
+// Same as HCSR04_PollEcho, but also returns when and in which slot the ping went out
+HCSR04_Status HCSR04_PollSample(HCSR04_Device device, struct HCSR04_Sample * sample);
+
+// Take turns pinging the given devices (HCSR04_MASK bits), one every guard timer counts (max ~32ms),
+// in the background on output compare B. Each ping only has its own slot to come back in: an echo still
+// out when the next slot starts is nothing inside the window, HCSR04_Status_NoEcho (so a clear path or
+// anything past ~guard of range reads as no echo, not as the last thing seen). An echo that only starts
+// in another sensor's slot is rejected as HCSR04_Status_Crosstalk. A sensor still holding its echo line
+// when its turn comes around skips that slot. Collect results with HCSR04_PollSample.
+// Calling again changes the devices/guard, 0 devices stops it.
+// zero on started (or changed/stopped), otherwise a single ping is still out, try again once it's done
+int HCSR04_StartScheduler(unsigned char devices, unsigned int guard);
+
+// Stop the scheduler, pings already out get a single ping's deadline (HCSR04_TIMEOUT_STEP) to finish
+void HCSR04_StopScheduler(void);
+
+// Ping each of the given devices (HCSR04_MASK bits) once, in a slot of its own, whether the scheduler
+// covers it or not (eg. a sensor turned off that still has to be read now and then). Starts the slots
+// if the scheduler isn't running, at its last guard. Collect the result with HCSR04_PollSample as usual
+// zero on queued, otherwise a single ping is still out
+int HCSR04_RequestPing(unsigned char devices);
+
+// Adaptive rate for the scheduler: once the echo for the current slot is back, the next slot starts after
+// settle timer counts instead of waiting out the rest of the guard. Close obstacles get pinged as fast as
+// their echoes come back, a clear path falls back to one slot per guard. 0 turns it off (fixed guard)
+void HCSR04_SetAdaptiveRate(unsigned int settle);
+
+// Set the air temperature, in 1/8 degrees C (eg. from LM75A_PollTemp), used by HCSR04_DurationToMm
+// Works out the speed of sound (331.3 + 0.606 * T m/s) once here, so the conversion is a single multiply
+void HCSR04_SetTemperature(int eighths);
+
+// Convert a duration (same units as HCSR04_GetEchoDuration) to mm at the current temperature,
+// integer only. HCSR04_NO_ECHO comes back as HCSR04_NO_ECHO_MM
+unsigned int HCSR04_DurationToMm(long duration);
+
+// Register a function to be called (from the ISR) whenever a measurement completes, 0 to disable
+void HCSR04_SetCallback(HCSR04_Callback callback);
+
+// Echo edges are timed through the pin change library (pcint.h), HCSR04_InitDevice registers for them
+
+// Time the center echo (PB0 / ICP1) with the Timer1 input capture unit instead of the pin change ISR,
+// so the edges are latched in hardware free of interrupt latency. Call after Timer_Init.
+// Requires TIMER1_CAPT_vect to call HCSR04_CaptureISR. 0 goes back to the pin change ISR.
+// Only switch while the center sensor has no ping out.
+void HCSR04_SetInputCapture(char enable);
+
+// ISR for the Timer1 input capture, call from TIMER1_CAPT_vect
+void HCSR04_CaptureISR(void);
+
+// ISR for the ping deadline and scheduler slots, call from TIMER1_COMPB_vect
+void HCSR04_TimeoutISR(void);
@@ -10,18 +10,25 @@
 #include <util/delay.h> // have to add, has delay implementation (requires F_CPU to be defined)
 #include <avr/sleep.h>
 #include <avr/interrupt.h>
+#include <util/atomic.h>
 #include "timer.h"
 #include "atd.h"
 #include "i2c.h"
+#include "LM75A.h"
 #include "sci.h"
 #include "gd03/gd03.h"
 #include "hc-sr04/hc-sr04.h"
 #include "sen0427/sen0427.h"
 #include "backup-sens/backup-sens.h"
+#include "range-filter/range-filter.h"
 #include "mcp23017\mcp23017.h"
 #include "pico\pico.h"
-#include <stdio.h>
-#define LED 0b00000100 // PC2, pin 25
+#include "trace.h"
+#include "pcint.h"
+#include "event.h"
+#include "board.h"
+#include "battery/battery.h"
+#define LED BOARD_LED // PC2, pin 25
 
 /************************************************************************/
 /* Global Variables                                                     */
@@ -29,12 +36,92 @@
 
 // constant for timer output compare offset, init and ISR rearm
 const unsigned int _Timer_OC_Offset = 1000; // 1 / (16000000 / 8 / 1000) = 0.5ms (prescale 8) -- wanted prescale 16
-const unsigned int timerEventCount = 2000; // every 100 ms
+const unsigned int timerEventCount = 2000; // every 100 ms (default, the pico can change it)
+const unsigned char atodPeriod = 50; // timer 0 counts (4us) between AtoD conversions, 200us (5kHz)
+const unsigned int temperaturePeriod = 10000; // timer ticks between LM75A reads, 5s (air temperature is slow)
+const unsigned int batteryPeriod = 500; // timer ticks between battery updates, 250ms (the scan does the converting)
+const unsigned int pingWait = 200; // timer ticks an R waits for its one-shot pings, 100ms (3 slots at the longest guard)
 // global counter for timer ISR, used as reference to coordinate activities
 volatile unsigned int _Ticks = 0;
-// global tracker for bump sensor data
-volatile char bump_L = 0;
-volatile char bump_R = 0;
+// free running copy of the tick count (never reset), used to timestamp captures
+volatile unsigned int _Timestamp = 0;
+// ultrasonic sensors (PICO_SENSOR_US_ bits), guard and settle time the scheduler is running with
+unsigned char scheduledPings = 0;
+unsigned int scheduledGuard = 0;
+unsigned int scheduledSettle = 0;
+// ultrasonic sensors (PICO_SENSOR_US_ bits) an R is waiting on a one-shot ping from, and since when (timer ticks)
+unsigned char requestedPings = 0;
+unsigned int requestedTime = 0;
+char pingsRequested = 0; // the pending R has had its one-shots queued already
+// IR sensors (PICO_SENSOR_IR_ bits) ranging continuously
+unsigned char continuousIR = 0;
+// outlier filter for each range sensor (PICO_RANGE_ channels), and the config each was last set up with
+struct RangeFilter rangeFilters[PICO_RANGE_CHANNELS];
+unsigned char rangeFilterConfig[PICO_RANGE_CHANNELS];
+// AtoD channels converted in the background by the ADC ISR, results by their index here
+#define SCAN_WEIGHT 0
+#define SCAN_BANDGAP (BOARD_GD03 ? 1 : 0)
+#define SCAN_BATTERY (SCAN_BANDGAP + 1)
+const struct AtoD_ScanChannel scanChannels[] = {
+#if BOARD_GD03
+	{ GD03_CHANNEL, GD03_OVERSAMPLE, BOARD_ATOD_REF },                 // weight, 12 bits
+#endif
+	{ AtoD_1V1, BATTERY_BANDGAP_OVERSAMPLE, BOARD_ATOD_REF },          // internal bandgap, 13 bits
+#if BOARD_BATTERY_DIV
+	{ AtoD_Channel_1, BATTERY_DIVIDER_OVERSAMPLE, BOARD_ATOD_REF }     // battery divider, 12 bits
+#endif
+};
+// when the battery was last updated (timer ticks)
+unsigned int batteryTime = 0;
+// periodic frames since the weight was last in one (settings.WeightPeriod)
+unsigned char weightFrames = 0;
+// detector event waiting for room in the transmit queue
+struct GD03_Event weightEvent;
+char weightEventPending = 0;
+// 1 while an LM75A read is out on the I2C bus, and when it was started (timer ticks)
+char temperatureReading = 0;
+unsigned int temperatureTime = 0;
+
+/************************************************************************/
+/* Local Definitions (private functions)                                */
+/************************************************************************/
+
+// atomic snapshot of _Timestamp, in timer ticks
+unsigned int captureTime(void);
+
+// a Timer_Now time (in the recent past) converted to _Timestamp ticks
+unsigned int timestampOf(unsigned long time);
+
+// (re)start the ultrasonic scheduler if the enabled sensors, guard or settle time have changed
+void updateScheduler(struct PicoSettings * settings);
+
+// ping any ultrasonic sensor an R asked for that the scheduler isn't already covering, once
+void requestPings(struct PicoSettings * settings);
+
+// HCSR04_MASK bits for a set of PICO_SENSOR_US_ bits
+unsigned char pingDevices(unsigned char pings);
+
+// store any finished ultrasonic samples in the frame, raw and filtered (never waits)
+void collectPings(struct PicoFrame * frame);
+
+// start or stop continuous ranging on the IR sensors if the enabled sensors have changed
+void updateIR(struct PicoSettings * settings, struct PicoFrame * frame);
+
+// store a new IR sample, raw and filtered, if the sensor has signalled one (never waits for the sensor)
+void collectIR(struct PicoFrame * frame);
+
+// take everything the ISRs have queued (event.h) and add it to the frame's counts (never waits)
+void collectEvents(struct PicoFrame * frame);
+
+// set up any range filter the pico has reconfigured
+void updateFilters(struct PicoSettings * settings);
+
+// start an LM75A read when one is due and move it along, passing the result on to the ultrasonic mm
+// conversion. finish waits for a read that's out to be done, so the I2C bus is free for something else
+void updateTemperature(struct PicoFrame * frame, char finish);
+
+// work out the battery voltage and low flag from the AtoD scan when an update is due (never waits)
+void updateBattery(struct PicoFrame * frame);
 
 
 /************************************************************************/
@@ -44,23 +131,43 @@ volatile char bump_R = 0;
 int main(void)
 {	
 	// make portc2 (pin 25) an output (PC2)
-	DDRC |= LED;
+	BOARD_DDR_REG(BOARD_LED_PORT) |= LED;
 	// one-time initialization section
 	// bring up the timer, requires ISR!
 	Timer_Init(Timer_Prescale_8, _Timer_OC_Offset); // 1ms intervals
+	// extend TCNT1 to 32 bits for Timer_Now, requires ISR for timer overflow
+	Timer_InitNow();
 	// enable sleep mode, for idle, sort of similar to WAI on 9S12X (13.2)
 	sleep_enable();
+	// drivers not on this robot (board.h) are left out entirely
+#if BOARD_I2C
 	// bring up the I2C bus, at 400kHz operation
 	I2C_Init(F_CPU, I2CBus400);
-	GD03_Init();
+#endif
+	// all on the board's reference, so the weight keeps its scale and the bandgap gives the reference voltage.
+	// Paced by timer 0 so the samples are evenly spaced whatever main is doing (each channel takes 4^n + 1
+	// conversions per pass), requires ISR for the ADC
+	AtoD_ScanInit(scanChannels, sizeof(scanChannels) / sizeof(scanChannels[0]), atodPeriod);
+	Battery_Init(SCAN_BANDGAP, SCAN_BATTERY);
+#if BOARD_GD03
+	GD03_Init(SCAN_WEIGHT);
+#endif
+#if BOARD_SEN0427
 	SEN0427_InitDevice(SEN0427_R);
 	//SEN0427_InitAll();
+#endif
 	//MCP23017_Init(MCP23017_PORTB);	
 	
-	// requires ISR for PCI2
+#if BOARD_BACK_SENS
+	// requires ISRs for INT0 & INT1, and the timer compare A ISR for debounce
 	Back_Sens_InitAll();
+#endif
+#if BOARD_HCSR04
 	// requires ISR for PCI2 & PCI0
 	HCSR04_InitAll();
+	// center echo is on ICP1, time it in hardware (requires ISR for timer input capture)
+	HCSR04_SetInputCapture(1);
+#endif
 	// not compatible with SCI initialization
 	Pico_InitCommunication();
 	
@@ -80,38 +187,146 @@ int main(void)
 		frame.Motor_FL_Speed = 0;
 		frame.Motor_FR_Speed = 0;
 		frame.Battery_Low = 0;
+		frame.Battery_Voltage = 0;
 		frame.Weight = 0;
+		frame.Weight_Fine = 0;
+		frame.Sequence = 0;
+		frame.Frame_Time = 0;
+		frame.IR_L_Time = 0;
+		frame.IR_R_Time = 0;
+		frame.Ultrasonic_L_Time = 0;
+		frame.Ultrasonic_C_Time = 0;
+		frame.Ultrasonic_R_Time = 0;
+		frame.Weight_Time = 0;
+		frame.IR_L_Raw = 0;
+		frame.IR_R_Raw = 0;
+		frame.Ultrasonic_L_Raw = 0;
+		frame.Ultrasonic_C_Raw = 0;
+		frame.Ultrasonic_R_Raw = 0;
+		frame.Ultrasonic_L_Distance = 0;
+		frame.Ultrasonic_C_Distance = 0;
+		frame.Ultrasonic_R_Distance = 0;
+		frame.Temperature = HCSR04_DEFAULT_TEMPERATURE;
+		frame.Bump_L_Count = 0;
+		frame.Bump_R_Count = 0;
+		frame.Events_Dropped = 0;
+		frame.Weight_Grams = 0;
+	struct PicoSettings settings;
+		settings.FramePeriod = timerEventCount;
+		settings.SensorEnable = 0xFF;
+		settings.ReadRequest = 0;
+		settings.UltrasonicGuard = HCSR04_DEFAULT_GUARD;
+		settings.UltrasonicSettle = HCSR04_DEFAULT_SETTLE;
+		// 5 sample Hampel on everything, enough to drop a lone 0/255 or a missed echo without lagging much
+		for(unsigned char channel = 0; channel < PICO_RANGE_CHANNELS; ++channel)
+			settings.RangeFilter[channel] = RANGE_FILTER_HAMPEL | 5;
+		settings.TareRequest = 0;
+		settings.WeightPeriod = 1;
+#if BOARD_LM75A
+	// first temperature right away, from then on it's read in the background
+	temperatureReading = !LM75A_StartRead();
+	updateTemperature(&frame, 1);
+#endif
 	// main program loop - don't exit
 	while(1)
 	{
 		sleep_cpu();
 
-		//PORTC ^= LED;
-		// go idle!
-		//PORTD |= 0b00010000;
-		//DDRB |= HCSR04_R_Trig;
-		//PORTB |= HCSR04_R_Trig;
-		//PORTD &= ~HCSR04_R;
-		if(_Ticks > timerEventCount){
-			_Ticks = 0;
-			PORTC ^= LED;
-			frame.Weight = GD03_CaptureAtoDVal();
-			//PORTC &= ~LED;		
-			 frame.Ultrasonic_L_Duration = HCSR04_GetEchoDuration(HCSR04_L);
-			frame.Bump_L = bump_L;
-			frame.Bump_R = bump_R;
-			frame.Ultrasonic_C_Duration = HCSR04_GetEchoDuration(HCSR04_C);
-			//
-			frame.Ultrasonic_R_Duration = HCSR04_GetEchoDuration(HCSR04_R);
+		// send out more of a trace dump if one was asked for (debug builds only)
+#ifdef TRACE_ENABLED
+		Pico_SendTrace();
+#endif
+		// act on anything the pico has sent (RX is interrupt driven, this never waits)
+		Pico_ReceiveData(&settings);
+		updateScheduler(&settings);
+		requestPings(&settings);
+		updateIR(&settings, &frame);
+		updateFilters(&settings);
+		updateTemperature(&frame, 0);
+		updateBattery(&frame);
+		// the scheduler keeps the ultrasonic sensors going in the background, keep the frame up to date
+		collectPings(&frame);
+		collectIR(&frame);
+		// drained every pass, so the queue only has to cover one pass (not a whole frame period)
+		collectEvents(&frame);
+#if BOARD_GD03
+		// weight events go straight out, not with the next frame (held until the transmit queue has room)
+		if(!weightEventPending)
+			weightEventPending = GD03_Update(&weightEvent) != GD03_Event_None;
+		if(weightEventPending && !Pico_SendWeightEvent(weightEvent.Type, weightEvent.Grams, timestampOf(weightEvent.Time)))
+			weightEventPending = 0;
+#endif
+		char periodic;
+		// 16 bit value updated by the timer ISR, read (and reset) it whole
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			periodic = _Ticks > settings.FramePeriod;
+		}
+		// an R waits for its one-shot pings to come back (or give up), so it reports them
+		char reading = settings.ReadRequest && !requestedPings;
+		if(periodic || reading){
+			// sensors to read this time around, anything the pico asked for plus the periodic set
+			unsigned char sensors = 0;
+			if(reading){
+				sensors = settings.ReadRequest;
+				settings.ReadRequest = 0;
+				pingsRequested = 0;
+			}
+			if(periodic){
+				ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+				{
+					_Ticks = 0;
+				}
+				unsigned char enabled = settings.SensorEnable;
+				// the weight only every so often, the detector's events cover anything in between
+				if(++weightFrames < settings.WeightPeriod)
+					enabled &= ~PICO_SENSOR_WEIGHT;
+				else
+					weightFrames = 0;
+				sensors |= enabled;
+			}
+#if BOARD_GD03
+			// zero the scale on what's on it now, the next weight read is against it
+			if(settings.TareRequest){
+				GD03_Tare();
+				settings.TareRequest = 0;
+			}
+			if(sensors & PICO_SENSOR_WEIGHT){
+				frame.Weight = GD03_CaptureAtoDVal();
+				frame.Weight_Fine = GD03_GetCaptureFine();
+				frame.Weight_Grams = GD03_CaptureGrams();
+				// when it was actually sampled, not when main got around to it
+				frame.Weight_Time = timestampOf(GD03_GetCaptureTime());
+			}
+#endif
+#if BOARD_BACK_SENS
+			if(sensors & PICO_SENSOR_BUMPS){
+				frame.Bump_L = Back_Sens_GetState(Back_Sens_L);
+				frame.Bump_R = Back_Sens_GetState(Back_Sens_R);
+			}
+#endif
 			//
 			//frame.IR_L_Distance = SEN0427_CaptureDistance(SEN0427_L);
 			//
-			frame.IR_R_Distance = SEN0427_CaptureDistance(SEN0427_R);
-			//PORTC &= ~LED;
-			//TODO: Set up code to retrieve battery level from GPIO
-
+#if BOARD_SEN0427
+			// while it's ranging continuously collectIR keeps the frame up to date
+			if((sensors & PICO_SENSOR_IR_R) && !(continuousIR & PICO_SENSOR_IR_R)){
+				// shares the I2C bus with the LM75A
+				updateTemperature(&frame, 1);
+				frame.IR_R_Raw = SEN0427_CaptureDistance(SEN0427_R);
+				frame.IR_R_Distance = RangeFilter_Add(&rangeFilters[PICO_RANGE_IR_R], frame.IR_R_Raw);
+				frame.IR_R_Time = captureTime();
+			}
+#endif
 			//TODO: Set up encoder data	
-			Pico_SendData(frame);						
+
+			// ultrasonic values are the latest the scheduler has, each with its own capture time
+			frame.Frame_Time = captureTime();
+			// counts are since the last frame the pico actually got, a dropped frame's carry over
+			if(!Pico_SendData(frame)){
+				frame.Bump_L_Count = 0;
+				frame.Bump_R_Count = 0;
+			}
 		}
 		
 	}
@@ -129,19 +344,368 @@ ISR (TIMER1_COMPA_vect)
 	
 	// up the global tick count
 	++_Ticks;
+	++_Timestamp;
+
+#if BOARD_BACK_SENS
+	// settle any bump switch that's done bouncing
+	Back_Sens_TimerISR();
+#endif
 }
 
-// ISR for PCI2, covering PCINT23 through PCINT16
-ISR (PCINT2_vect)
+// conversion complete interrupt for the AtoD, moves the channel scan along
+ISR (ADC_vect)
+{
+	AtoD_ScanISR();
+}
+
+// overflow interrupt for timer, extends TCNT1 for Timer_Now
+ISR (TIMER1_OVF_vect)
+{
+	Timer_OverflowISR();
+}
+
+#if BOARD_HCSR04
+// output compare B interrupt for timer, ultrasonic ping deadline and scheduler slots
+ISR (TIMER1_COMPB_vect)
+{
+	HCSR04_TimeoutISR();
+}
+
+// input capture interrupt for timer, latches the center ultrasonic echo edges
+ISR (TIMER1_CAPT_vect)
+{
+	HCSR04_CaptureISR();
+}
+#endif
+
+// receive complete interrupt for SCI0, queues bytes from the pico
+ISR (USART_RX_vect)
+{
+	SCI0_RxISR();
+}
+
+// data register empty interrupt for SCI0, drains the transmit queue
+ISR (USART_UDRE_vect)
+{
+	SCI0_TxISR();
+}
+
+#if BOARD_BACK_SENS
+// external interrupt 0, left bump switch
+ISR (INT0_vect)
+{
+	Back_Sens_ISR(Back_Sens_L);
+}
+
+// external interrupt 1, right bump switch
+ISR (INT1_vect)
 {
-	HCSR04_ISR();
+	Back_Sens_ISR(Back_Sens_R);
+}
+#endif
 
-	bump_L = Back_Sens_ISR(Back_Sens_L);
-	bump_R = Back_Sens_ISR(Back_Sens_R);
+// only the pin change groups something is on (ultrasonic echoes, IR sample ready)
+#if BOARD_PCINT_PINS(BOARD_PORT_D)
+// ISR for PCI2, covering PCINT23 through PCINT16, only the handlers for pins that changed run
+ISR (PCINT2_vect)
+{
+	PCINT_ISR(PCINT_PortD);
 }
+#endif
 
+#if BOARD_PCINT_PINS(BOARD_PORT_B)
 // ISR for PCI0, covering PCINT0 through PCINT8
 ISR (PCINT0_vect)
 {
-	HCSR04_ISR();
+	PCINT_ISR(PCINT_PortB);
+}
+#endif
+
+/************************************************************************/
+/* Local  Implementation                                                */
+/************************************************************************/
+
+unsigned int captureTime(void)
+{
+	unsigned int time;
+	// 16 bit value updated by the timer ISR, don't let it change halfway through the read
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		time = _Timestamp;
+	}
+	return time;
+}
+
+unsigned int timestampOf(unsigned long time)
+{
+	// both count the same timer 1, _Timestamp just ticks once every _Timer_OC_Offset counts
+	return captureTime() - (unsigned int)((Timer_Now() - time) / _Timer_OC_Offset);
 }
+
+void updateScheduler(struct PicoSettings * settings)
+{
+#if BOARD_HCSR04
+	unsigned char pings = settings->SensorEnable & (PICO_SENSOR_US_L | PICO_SENSOR_US_C | PICO_SENSOR_US_R);
+
+	if(settings->UltrasonicSettle != scheduledSettle)
+	{
+		HCSR04_SetAdaptiveRate(settings->UltrasonicSettle);
+		scheduledSettle = settings->UltrasonicSettle;
+	}
+
+	if(pings == scheduledPings && settings->UltrasonicGuard == scheduledGuard)
+	{
+		return;
+	}
+
+	// a single ping still out holds it off, left as changed so it's tried again next time around
+	if(HCSR04_StartScheduler(pingDevices(pings), settings->UltrasonicGuard))
+	{
+		return;
+	}
+	scheduledPings = pings;
+	scheduledGuard = settings->UltrasonicGuard;
+#endif
+}
+
+void updateIR(struct PicoSettings * settings, struct PicoFrame * frame)
+{
+#if BOARD_SEN0427
+	unsigned char ranging = settings->SensorEnable & PICO_SENSOR_IR_R;
+
+	if(ranging == continuousIR)
+	{
+		return;
+	}
+
+	// shares the I2C bus with the LM75A
+	updateTemperature(frame, 1);
+	if(!ranging)
+	{
+		SEN0427_StopContinuousMeasurement(SEN0427_R);
+		continuousIR = 0;
+	}
+	else if(!SEN0427_StartContinuousMeasurement(SEN0427_R))
+	{
+		continuousIR = ranging;
+	}
+#endif
+}
+
+void collectIR(struct PicoFrame * frame)
+{
+#if BOARD_SEN0427
+	unsigned char distance;
+	unsigned long time;
+
+	// a pin check, the bus is only touched once there's a sample to read
+	if(!(continuousIR & PICO_SENSOR_IR_R) || !SEN0427_SampleReady(SEN0427_R))
+	{
+		return;
+	}
+
+	// shares the I2C bus with the LM75A
+	updateTemperature(frame, 1);
+	if(SEN0427_PollSample(SEN0427_R, &distance, &time))
+	{
+		return;
+	}
+	frame->IR_R_Raw = distance;
+	frame->IR_R_Distance = RangeFilter_Add(&rangeFilters[PICO_RANGE_IR_R], distance);
+	// when the sensor signalled it, not when main got around to it
+	frame->IR_R_Time = timestampOf(time);
+#endif
+}
+
+void requestPings(struct PicoSettings * settings)
+{
+#if BOARD_HCSR04
+	// the scheduler already keeps the enabled ones up to date
+	unsigned char pings = settings->ReadRequest & (PICO_SENSOR_US_L | PICO_SENSOR_US_C | PICO_SENSOR_US_R)
+		& ~scheduledPings;
+
+	if(requestedPings)
+	{
+		// a one-shot that never got its slot (eg. an echo line stuck high) doesn't hold the read up forever
+		if(captureTime() - requestedTime >= pingWait)
+		{
+			requestedPings = 0;
+		}
+		return;
+	}
+	// queued once each R, settings.ReadRequest stays set until the frame goes
+	if(!pings || pingsRequested)
+	{
+		return;
+	}
+	// a single ping still out holds it off, tried again next time around
+	if(!HCSR04_RequestPing(pingDevices(pings)))
+	{
+		requestedPings = pings;
+		requestedTime = captureTime();
+		pingsRequested = 1;
+	}
+#endif
+}
+
+unsigned char pingDevices(unsigned char pings)
+{
+	unsigned char devices = 0;
+
+	if(pings & PICO_SENSOR_US_L)
+		devices |= HCSR04_MASK(HCSR04_L);
+	if(pings & PICO_SENSOR_US_C)
+		devices |= HCSR04_MASK(HCSR04_C);
+	if(pings & PICO_SENSOR_US_R)
+		devices |= HCSR04_MASK(HCSR04_R);
+	return devices;
+}
+
+void collectPings(struct PicoFrame * frame)
+{
+#if BOARD_HCSR04
+	struct HCSR04_Sample sample;
+	long filtered;
+
+	for(HCSR04_Device device = HCSR04_L; device < HCSR04_DEVICE_COUNT; ++device)
+	{
+		// a ping with nothing back inside its slot still counts, it comes back as HCSR04_NO_ECHO (nothing
+		// in range). A crosstalk rejection only says that sample can't be trusted, so it's dropped and the
+		// last value stands
+		switch(HCSR04_PollSample(device, &sample))
+		{
+			case HCSR04_Status_Ready:
+			case HCSR04_Status_NoEcho:
+				break;
+			case HCSR04_Status_Crosstalk:
+				// a one-shot that got rejected isn't coming back, don't hold an R up for it
+				requestedPings &= ~(PICO_SENSOR_US_L >> device);
+				continue;
+			default:
+				continue;
+		}
+		requestedPings &= ~(PICO_SENSOR_US_L >> device);
+
+		// devices are in the same order as their range channels
+		filtered = RangeFilter_Add(&rangeFilters[PICO_RANGE_US_L + device], (unsigned int)sample.Duration);
+		switch(device)
+		{
+			case HCSR04_L:
+				frame->Ultrasonic_L_Raw = sample.Duration;
+				frame->Ultrasonic_L_Duration = filtered;
+				frame->Ultrasonic_L_Distance = HCSR04_DurationToMm(filtered);
+				frame->Ultrasonic_L_Time = timestampOf(sample.FireTime);
+				break;
+			case HCSR04_C:
+				frame->Ultrasonic_C_Raw = sample.Duration;
+				frame->Ultrasonic_C_Duration = filtered;
+				frame->Ultrasonic_C_Distance = HCSR04_DurationToMm(filtered);
+				frame->Ultrasonic_C_Time = timestampOf(sample.FireTime);
+				break;
+			case HCSR04_R:
+				frame->Ultrasonic_R_Raw = sample.Duration;
+				frame->Ultrasonic_R_Duration = filtered;
+				frame->Ultrasonic_R_Distance = HCSR04_DurationToMm(filtered);
+				frame->Ultrasonic_R_Time = timestampOf(sample.FireTime);
+				break;
+			default:
+				break;
+		}
+	}
+#endif
+}
+
+void collectEvents(struct PicoFrame * frame)
+{
+	struct Event event;
+
+	while(!Event_Get(&event))
+	{
+		switch(event.Type)
+		{
+			case Event_BumpPress:
+				// stop at FF rather than wrap back to looking like nothing happened
+				if(event.Source == 0 && frame->Bump_L_Count != 0xFF)
+					++frame->Bump_L_Count;
+				else if(event.Source == 1 && frame->Bump_R_Count != 0xFF)
+					++frame->Bump_R_Count;
+				break;
+			case Event_BumpRelease:
+			default:
+				// the state itself is read from the driver when the frame goes out
+				break;
+		}
+	}
+	frame->Events_Dropped = Event_Dropped();
+}
+
+void updateFilters(struct PicoSettings * settings)
+{
+	for(unsigned char channel = 0; channel < PICO_RANGE_CHANNELS; ++channel)
+	{
+		// starting over throws away the history, so only when the config actually changed
+		if(settings->RangeFilter[channel] != rangeFilterConfig[channel])
+		{
+			RangeFilter_Init(&rangeFilters[channel], settings->RangeFilter[channel]);
+			rangeFilterConfig[channel] = settings->RangeFilter[channel];
+		}
+	}
+}
+
+void updateTemperature(struct PicoFrame * frame, char finish)
+{
+#if BOARD_LM75A
+	int eighths;
+	int result;
+
+	// time for another read
+	if(!temperatureReading && !finish && captureTime() - temperatureTime >= temperaturePeriod)
+	{
+		temperatureReading = !LM75A_StartRead();
+		temperatureTime = captureTime();
+	}
+	if(!temperatureReading)
+	{
+		return;
+	}
+
+	do
+	{
+		result = LM75A_PollTemp(&eighths);
+	} while(finish && result == 1);
+
+	// still on the bus, pick it up next time around
+	if(result == 1)
+	{
+		return;
+	}
+	temperatureReading = 0;
+	// a failed read keeps the last temperature, there'll be another go next period
+	if(!result)
+	{
+#if BOARD_HCSR04
+		HCSR04_SetTemperature(eighths);
+#endif
+		frame->Temperature = eighths;
+		TRACE(Trace_Temperature, eighths);
+	}
+#endif
+}
+
+void updateBattery(struct PicoFrame * frame)
+{
+	// the voltage moves slowly, a few times a second is plenty
+	if(captureTime() - batteryTime < batteryPeriod)
+	{
+		return;
+	}
+	batteryTime = captureTime();
+
+	// no scan results yet, keep what the frame has
+	if(Battery_Update())
+	{
+		return;
+	}
+	frame->Battery_Voltage = Battery_GetMillivolts();
+	frame->Battery_Low = Battery_IsLow();
+}
\ No newline at end of file
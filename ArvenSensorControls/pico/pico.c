@@ -7,10 +7,12 @@
 
 #define F_CPU 16E6 // with external xtal enabled, and clock div/8, bus == 2MHz
 #include <avr/io.h>
-#include <stdio.h>
+#include <avr/pgmspace.h>
+#include <util/crc16.h>
 #include "sci.h"
 #include "pico.h"
-#include <string.h>
+#include "trace.h"
+#include "../board.h"
 
 /************************************************************************/
 /* Local Definitions (private functions)                                */
@@ -35,10 +37,71 @@
 */
 char parseBumpVal(char bump_L,char bump_R);
 
+/*
+* Write the low (digits) nibbles of value into dest as upper case
+* hex characters, most significant first (same as "%0nX").
+* Returns the position just past the last character written.
+*/
+char * writeHex(char * dest, unsigned int value, unsigned char digits);
+
+/*
+* Write a 20 bit value as 5 hex characters (same as "%05lX" for
+* values within 00000-FFFFF, which covers the ultrasonic segments)
+*/
+char * writeHex20(char * dest, unsigned long value);
+
+// compare the frame against the last one sent and build the segment 1 change mask
+unsigned char computeChangeMask(struct PicoFrame * frame);
+
+// build and queue the frame as ASCII hex segments (see pico.h)
+// a delta frame (full == 0) only carries the segments flagged in mask
+// zero on frame queued, otherwise it was dropped
+int sendAsciiFrame(struct PicoFrame * frame, unsigned char mask, char full);
+
+// build and queue the frame as a COBS encoded binary payload with CRC (see pico.h)
+// a delta frame (full == 0) only carries the fields flagged in mask
+// zero on frame queued, otherwise it was dropped
+int sendBinaryFrame(struct PicoFrame * frame, unsigned char mask, char full);
+
+/*
+* Consistent overhead byte stuffing: encode len bytes of src into dest
+* so that dest contains no zero bytes. dest must hold len + 1 + len / 254
+* bytes. Returns the number of bytes written (the 0x00 delimiter is not added).
+*/
+unsigned char cobsEncode(unsigned char * dest, const unsigned char * src, unsigned char len);
+
+// write value into dest as 2 bytes, little endian, saturated to 0000-FFFF
+void writeU16(unsigned char * dest, long value);
+
+// act on a complete command from the pico
+void runCommand(char command, unsigned int argument, struct PicoSettings * settings);
+
 /************************************************************************/
 /* Global Variables                                                     */
 /************************************************************************/
 
+// nibble to ASCII lookup, used to serialize the frame segments (flash, it never changes)
+const char hexDigits[16] PROGMEM = "0123456789ABCDEF";
+
+// wire format used for outgoing frames, ASCII unless the pico asks otherwise
+volatile Pico_FrameFormat frameFormat = Pico_FrameFormat_ASCII;
+
+// full frame every keyframeInterval frames, deltas in between (0 = every frame is full)
+volatile unsigned char keyframeInterval = 0;
+// frames sent since the last full frame
+unsigned char framesSinceKeyframe = 0;
+// last frame actually queued, used to work out what changed
+struct PicoFrame lastFrame;
+// 0 until the first frame goes out, so it is always full with every segment flagged
+char lastFrameValid = 0;
+// rolling frame counter, stamped on every frame handed to Pico_SendData
+unsigned char frameSequence = 0;
+
+// command parser state, carried between calls to Pico_ReceiveData
+char commandLetter = 0;            // 0 while waiting for a '!'
+unsigned int commandArgument = 0;
+unsigned char commandDigits = 0;
+
 
 /************************************************************************/
 /* Header Implementation                                                */
@@ -46,72 +109,208 @@ char parseBumpVal(char bump_L,char bump_R);
 
 void Pico_InitCommunication(void)
 {	
-	// no interrupts for read (TODO: Should use interrupts)
-	if(SCI0_Init(F_CPU, PICO_BAUD_RATE, 0)){
-		PORTC |= 0b00000100;
+	// interrupts for read, commands are queued by the RX ISR
+	if(SCI0_Init(F_CPU, PICO_BAUD_RATE, 1)){
+		BOARD_PORT_REG(BOARD_LED_PORT) |= BOARD_LED;
 	}
     // 8 bits, 1 stop bit, no parity
 }
 
-void Pico_SendData(struct PicoFrame frame)
-{
-	// Temporary buffer for holding a single value to be added to the frame
-	char buff[6];
-    // Initialize frame buffer that will hold the bytes to be send
-    char dataFrame[PICO_FRAME_LENGTH + 3];
-	// ensure the frame is empty
-	strcpy(dataFrame, "");
-	// Add the start byte
-	sprintf(buff, "%c", PICO_START_BYTE);
-	strcat(dataFrame, buff);	
-	// Add the byte indicating what data has changes (TODO: Figure out how to set this)
-	sprintf(buff, "%02X", 0b00100100);
-	strcat(dataFrame, buff);	
-    // add IR sensor data
-	sprintf(buff, "%02X", frame.IR_L_Distance);
-	strcat(dataFrame, buff);
-	sprintf(buff, "%02X", frame.IR_R_Distance);
-	strcat(dataFrame, buff);
-    // add ultrasonic sensor data
-	sprintf(buff, "%05lX", frame.Ultrasonic_L_Duration);
-	strcat(dataFrame, buff);
-	sprintf(buff, "%05lX", frame.Ultrasonic_C_Duration);
-	strcat(dataFrame, buff);
-	sprintf(buff, "%05lX", frame.Ultrasonic_R_Duration);
-	strcat(dataFrame, buff);
-	// add bump sensor data
-	sprintf(buff, "%c", parseBumpVal(frame.Bump_L, frame.Bump_R));
-	strcat(dataFrame, buff);
-    // add weight data
-	sprintf(buff, "%03X", frame.Weight);
-	strcat(dataFrame, buff);
-    // add battery data
-	sprintf(buff, "%c", frame.Battery_Low ? 1 : 0);
-	strcat(dataFrame, buff);
-	// add motor direction data 
-	sprintf(buff, "%02X", (frame.Motor_FL_Direction << 5) + (frame.Motor_FR_Direction << 4));
-	strcat(dataFrame, buff);
-    // add motor speed data
-	sprintf(buff, "%02X", frame.Motor_FL_Speed);
-	strcat(dataFrame, buff);
-	sprintf(buff, "%02X", frame.Motor_FR_Speed);
-	strcat(dataFrame, buff);
-    // add end frame byte
-	sprintf(buff, "%c", PICO_END_BYTE);
-	strcat(dataFrame, buff);	
-    // send out the actual frame
-	SCI0_TxString(dataFrame);
-	// send a new line for easier readability, the pico will ignore it
-	SCI0_TxString("\n");
-}
-
-void Pico_ReceiveData(void)
-{
-    unsigned char data;
-    while(!SCI0_RxByte(&data))
-    {
-        //TODO: Do something?
-    }
+void Pico_SetFrameFormat(Pico_FrameFormat format)
+{
+	frameFormat = format;
+	// the pico is parsing a different format now, give it a full frame first
+	framesSinceKeyframe = 0;
+}
+
+Pico_FrameFormat Pico_GetFrameFormat(void)
+{
+	return frameFormat;
+}
+
+void Pico_SetDeltaFrames(unsigned char interval)
+{
+	keyframeInterval = interval;
+	// start the next frame off as a keyframe so the pico has a full picture
+	framesSinceKeyframe = 0;
+}
+
+int Pico_SendData(struct PicoFrame frame)
+{
+	unsigned char mask = computeChangeMask(&frame);
+	// full frame when deltas are off, it's time for a keyframe, or nothing has been sent yet
+	char full = !keyframeInterval || !framesSinceKeyframe || !lastFrameValid;
+	int result;
+
+	// counts every frame, dropped or not, so the pico can spot gaps
+	frame.Sequence = frameSequence++;
+
+	switch(frameFormat)
+	{
+		case Pico_FrameFormat_Binary:
+			result = sendBinaryFrame(&frame, mask, full);
+			break;
+		case Pico_FrameFormat_ASCII:
+		default:
+			result = sendAsciiFrame(&frame, mask, full);
+			break;
+	}
+
+	TRACE(Trace_FrameSent, frame.Sequence | (result ? 0x100 : 0));
+
+	// only remember what actually went out, so anything dropped shows up as changed next time
+	if(!result)
+	{
+		lastFrame = frame;
+		lastFrameValid = 1;
+		if(keyframeInterval && ++framesSinceKeyframe >= keyframeInterval)
+		{
+			framesSinceKeyframe = 0;
+		}
+	}
+
+	return result;
+}
+
+int Pico_SendWeightEvent(unsigned char event, int grams, unsigned int time)
+{
+	// room for the trailing new line and the terminator
+	char ascii[12 + 2];
+	unsigned char payload[PICO_EVENT_BINARY_LENGTH + 2];
+	unsigned char encoded[PICO_EVENT_BINARY_LENGTH + 4];
+	unsigned char length = 0;
+	unsigned int crc = 0;
+	unsigned char i;
+	char * pos = ascii;
+	int result;
+
+	if(frameFormat == Pico_FrameFormat_Binary)
+	{
+		payload[length++] = event;
+		// two's complement bits as they are, writeU16 would clamp a negative weight to 0
+		writeU16(&payload[length], (unsigned int)grams);
+		writeU16(&payload[length + 2], time);
+		length += 4;
+		// same CRC and framing as a binary frame
+		for(i = 0; i < length; ++i)
+		{
+			crc = _crc_xmodem_update(crc, payload[i]);
+		}
+		payload[length++] = (unsigned char)crc;
+		payload[length++] = (unsigned char)(crc >> 8);
+		length = cobsEncode(encoded, payload, length);
+		encoded[length++] = 0x00;
+		result = SCI0_TxQueueData(encoded, length);
+	}
+	else
+	{
+		*pos++ = PICO_EVENT_START_BYTE;
+		pos = writeHex(pos, event, 2);
+		pos = writeHex(pos, grams, 4);
+		pos = writeHex(pos, time, 4);
+		*pos++ = PICO_END_BYTE;
+		*pos++ = '\n';
+		*pos = '\0';
+		result = SCI0_TxQueueString(ascii);
+	}
+
+	TRACE(Trace_WeightEvent, event | (result ? 0x100 : 0));
+	return result;
+}
+
+#ifdef TRACE_ENABLED
+void Pico_SendTrace(void)
+{
+	// room for the trailing new line and the terminator
+	char line[TRACE_DUMP_LINE_LENGTH + 1];
+	struct TraceEvent event;
+	char * pos;
+
+	// bare lines would land in the middle of the pico's COBS stream
+	if(frameFormat == Pico_FrameFormat_Binary)
+	{
+		Trace_CancelDump();
+		return;
+	}
+
+	while(SCI0_TxFree() >= TRACE_DUMP_LINE_LENGTH && Trace_NextDump(&event))
+	{
+		pos = line;
+		*pos++ = TRACE_DUMP_START_BYTE;
+		if(event.Id == Trace_DumpHeader)
+		{
+			*pos++ = TRACE_DUMP_HEADER_BYTE;
+			pos = writeHex(pos, (unsigned int)event.Time, 2);
+			pos = writeHex(pos, event.Arg, 4);
+		}
+		else
+		{
+			pos = writeHex(pos, event.Id, 2);
+			pos = writeHex(pos, (unsigned int)(event.Time >> 16), 4);
+			pos = writeHex(pos, (unsigned int)event.Time, 4);
+			pos = writeHex(pos, event.Arg, 4);
+		}
+		*pos++ = '\n';
+		*pos = '\0';
+		SCI0_TxQueueString(line);
+	}
+}
+#endif
+
+void Pico_ReceiveData(struct PicoSettings * settings)
+{
+	unsigned char data;
+	// only what the RX ISR has already queued, never wait for more
+	while(!SCI0_RxQueueByte(&data))
+	{
+		if(data == PICO_CMD_START_BYTE)
+		{
+			// always (re)start on a start byte, so a lost end byte can't wedge the parser
+			commandLetter = PICO_CMD_START_BYTE;
+			commandArgument = 0;
+			commandDigits = 0;
+		}
+		else if(!commandLetter)
+		{
+			// not in a command, ignore
+		}
+		else if(commandLetter == PICO_CMD_START_BYTE)
+		{
+			// first byte after the start is the command itself
+			commandLetter = data;
+		}
+		else if(data == PICO_END_BYTE)
+		{
+			if(commandDigits)
+			{
+				runCommand(commandLetter, commandArgument, settings);
+			}
+			commandLetter = 0;
+		}
+		else
+		{
+			unsigned char nibble;
+			if(data >= '0' && data <= '9')
+				nibble = data - '0';
+			else if(data >= 'A' && data <= 'F')
+				nibble = data - 'A' + 10;
+			else if(data >= 'a' && data <= 'f')
+				nibble = data - 'a' + 10;
+			else
+				nibble = 0xFF;
+
+			// bad digit or too many of them, drop the command
+			if(nibble == 0xFF || commandDigits >= PICO_CMD_MAX_DIGITS)
+			{
+				commandLetter = 0;
+			}
+			else
+			{
+				commandArgument = (commandArgument << 4) | nibble;
+				++commandDigits;
+			}
+		}
+	}
 }
 
 char parseBumpVal(char bump_L,char bump_R)
@@ -132,4 +331,412 @@ char parseBumpVal(char bump_L,char bump_R)
 	{
 		return 'D';
 	}
+}
+
+char * writeHex(char * dest, unsigned int value, unsigned char digits)
+{
+	char * end = dest + digits;
+	// fill from the right so the least significant nibble ends up last
+	while(end != dest)
+	{
+		*--end = pgm_read_byte(&hexDigits[value & 0x0F]);
+		value >>= 4;
+	}
+	return dest + digits;
+}
+
+char * writeHex20(char * dest, unsigned long value)
+{
+	// top nibble on its own so the rest can be done with 16 bit shifts
+	*dest++ = pgm_read_byte(&hexDigits[(unsigned char)(value >> 16) & 0x0F]);
+	return writeHex(dest, (unsigned int)value, 4);
+}
+
+int sendAsciiFrame(struct PicoFrame * frame, unsigned char mask, char full)
+{
+	// Initialize frame buffer that will hold the bytes to be sent
+	// (room for the start and end bytes, the trailing new line and the terminator)
+	char dataFrame[PICO_FRAME_LENGTH + PICO_TIMING_LENGTH + PICO_RAW_LENGTH + PICO_MM_LENGTH + PICO_EVENT_LENGTH
+		+ PICO_GRAMS_LENGTH + PICO_FINE_LENGTH + 4];
+	// write position within the frame, each segment lands at a known offset
+	char * pos = dataFrame;
+	// Add the start byte, which also tells the pico whether every segment follows
+	*pos++ = full ? PICO_START_BYTE : PICO_DELTA_START_BYTE;
+	// Add the byte indicating what data has changed
+	pos = writeHex(pos, mask, 2);
+	// add IR sensor data
+	if(full || (mask & PICO_CHANGED_IR_L))
+		pos = writeHex(pos, frame->IR_L_Distance, 2);
+	if(full || (mask & PICO_CHANGED_IR_R))
+		pos = writeHex(pos, frame->IR_R_Distance, 2);
+	// add ultrasonic sensor data
+	if(full || (mask & PICO_CHANGED_US_L))
+		pos = writeHex20(pos, frame->Ultrasonic_L_Duration);
+	if(full || (mask & PICO_CHANGED_US_C))
+		pos = writeHex20(pos, frame->Ultrasonic_C_Duration);
+	if(full || (mask & PICO_CHANGED_US_R))
+		pos = writeHex20(pos, frame->Ultrasonic_R_Duration);
+	// add bump sensor data
+	if(full || (mask & PICO_CHANGED_BUMPS))
+		*pos++ = parseBumpVal(frame->Bump_L, frame->Bump_R);
+	// add weight data
+	if(full || (mask & PICO_CHANGED_WEIGHT))
+		pos = writeHex(pos, frame->Weight, 3);
+	// add battery data, always (rounded to 10mV)
+	pos = writeHex(pos, (frame->Battery_Voltage + 5) / 10, 3);
+	if(full || (mask & PICO_CHANGED_ENCODERS))
+	{
+		// add motor direction data
+		pos = writeHex(pos, (frame->Motor_FL_Direction << 5) + (frame->Motor_FR_Direction << 4), 2);
+		// add motor speed data
+		pos = writeHex(pos, frame->Motor_FL_Speed, 2);
+		pos = writeHex(pos, frame->Motor_FR_Speed, 2);
+	}
+	// add the sequence number and frame time
+	pos = writeHex(pos, frame->Sequence, 2);
+	pos = writeHex(pos, frame->Frame_Time, 4);
+	// add capture times, only alongside the segment they belong to
+	if(full || (mask & PICO_CHANGED_IR_L))
+		pos = writeHex(pos, frame->IR_L_Time, 4);
+	if(full || (mask & PICO_CHANGED_IR_R))
+		pos = writeHex(pos, frame->IR_R_Time, 4);
+	if(full || (mask & PICO_CHANGED_US_L))
+		pos = writeHex(pos, frame->Ultrasonic_L_Time, 4);
+	if(full || (mask & PICO_CHANGED_US_C))
+		pos = writeHex(pos, frame->Ultrasonic_C_Time, 4);
+	if(full || (mask & PICO_CHANGED_US_R))
+		pos = writeHex(pos, frame->Ultrasonic_R_Time, 4);
+	if(full || (mask & PICO_CHANGED_WEIGHT))
+		pos = writeHex(pos, frame->Weight_Time, 4);
+	// add the unfiltered range values, also only alongside their segments
+	if(full || (mask & PICO_CHANGED_IR_L))
+		pos = writeHex(pos, frame->IR_L_Raw, 2);
+	if(full || (mask & PICO_CHANGED_IR_R))
+		pos = writeHex(pos, frame->IR_R_Raw, 2);
+	if(full || (mask & PICO_CHANGED_US_L))
+		pos = writeHex20(pos, frame->Ultrasonic_L_Raw);
+	if(full || (mask & PICO_CHANGED_US_C))
+		pos = writeHex20(pos, frame->Ultrasonic_C_Raw);
+	if(full || (mask & PICO_CHANGED_US_R))
+		pos = writeHex20(pos, frame->Ultrasonic_R_Raw);
+	// add the ultrasonic values in mm, and the temperature they were converted at
+	if(full || (mask & PICO_CHANGED_US_L))
+		pos = writeHex(pos, frame->Ultrasonic_L_Distance, 4);
+	if(full || (mask & PICO_CHANGED_US_C))
+		pos = writeHex(pos, frame->Ultrasonic_C_Distance, 4);
+	if(full || (mask & PICO_CHANGED_US_R))
+		pos = writeHex(pos, frame->Ultrasonic_R_Distance, 4);
+	pos = writeHex(pos, frame->Temperature, 4);
+	// add the bump counts since the last frame and the dropped event total, alongside the bump segment
+	if(full || (mask & PICO_CHANGED_BUMPS))
+	{
+		pos = writeHex(pos, frame->Bump_L_Count, 2);
+		pos = writeHex(pos, frame->Bump_R_Count, 2);
+		pos = writeHex(pos, frame->Events_Dropped, 4);
+	}
+	// add the calibrated weight, alongside the raw one
+	if(full || (mask & PICO_CHANGED_WEIGHT))
+		pos = writeHex(pos, frame->Weight_Grams, 4);
+	// add the low battery flag
+	pos = writeHex(pos, frame->Battery_Low != 0, 1);
+	// add the full 12 bit weight, alongside the 10 bit one
+	if(full || (mask & PICO_CHANGED_WEIGHT))
+		pos = writeHex(pos, frame->Weight_Fine, 3);
+	// add end frame byte
+	*pos++ = PICO_END_BYTE;
+	// add a new line for easier readability, the pico will ignore it
+	*pos++ = '\n';
+	*pos = '\0';
+	// queue the frame, the UDRE interrupt sends it out while we carry on
+	return SCI0_TxQueueString(dataFrame);
+}
+
+int sendBinaryFrame(struct PicoFrame * frame, unsigned char mask, char full)
+{
+	unsigned char payload[PICO_BINARY_PAYLOAD_LENGTH + 2];
+	// worst case COBS growth for a payload this short is a single byte, plus the delimiter
+	unsigned char encoded[PICO_BINARY_PAYLOAD_LENGTH + 4];
+	unsigned char length = 0;
+	unsigned int crc = 0;
+	unsigned char i;
+
+	// changed sensors
+	payload[length++] = mask;
+	// sequence number and frame time
+	payload[length++] = frame->Sequence;
+	writeU16(&payload[length], frame->Frame_Time);
+	length += 2;
+	// IR sensor data, each followed by its capture time
+	if(full || (mask & PICO_CHANGED_IR_L))
+	{
+		payload[length++] = frame->IR_L_Distance;
+		writeU16(&payload[length], frame->IR_L_Time);
+		length += 2;
+	}
+	if(full || (mask & PICO_CHANGED_IR_R))
+	{
+		payload[length++] = frame->IR_R_Distance;
+		writeU16(&payload[length], frame->IR_R_Time);
+		length += 2;
+	}
+	// ultrasonic sensor data, each followed by its capture time
+	if(full || (mask & PICO_CHANGED_US_L))
+	{
+		writeU16(&payload[length], frame->Ultrasonic_L_Duration);
+		writeU16(&payload[length + 2], frame->Ultrasonic_L_Time);
+		length += 4;
+	}
+	if(full || (mask & PICO_CHANGED_US_C))
+	{
+		writeU16(&payload[length], frame->Ultrasonic_C_Duration);
+		writeU16(&payload[length + 2], frame->Ultrasonic_C_Time);
+		length += 4;
+	}
+	if(full || (mask & PICO_CHANGED_US_R))
+	{
+		writeU16(&payload[length], frame->Ultrasonic_R_Duration);
+		writeU16(&payload[length + 2], frame->Ultrasonic_R_Time);
+		length += 4;
+	}
+	// weight data, followed by its capture time
+	if(full || (mask & PICO_CHANGED_WEIGHT))
+	{
+		writeU16(&payload[length], frame->Weight_Fine);
+		writeU16(&payload[length + 2], frame->Weight_Time);
+		length += 4;
+	}
+	// bump, battery and motor direction flags, always sent
+	payload[length++] = (frame->Motor_FL_Direction ? PICO_FLAG_MOTOR_FL_FWD : 0)
+		| (frame->Motor_FR_Direction ? PICO_FLAG_MOTOR_FR_FWD : 0)
+		| (frame->Battery_Low ? PICO_FLAG_BATTERY_LOW : 0)
+		| (frame->Bump_L ? PICO_FLAG_BUMP_L : 0)
+		| (frame->Bump_R ? PICO_FLAG_BUMP_R : 0);
+	// motor speed data
+	if(full || (mask & PICO_CHANGED_ENCODERS))
+	{
+		payload[length++] = frame->Motor_FL_Speed;
+		payload[length++] = frame->Motor_FR_Speed;
+	}
+	// unfiltered range values
+	if(full || (mask & PICO_CHANGED_IR_L))
+		payload[length++] = frame->IR_L_Raw;
+	if(full || (mask & PICO_CHANGED_IR_R))
+		payload[length++] = frame->IR_R_Raw;
+	if(full || (mask & PICO_CHANGED_US_L))
+	{
+		writeU16(&payload[length], frame->Ultrasonic_L_Raw);
+		length += 2;
+	}
+	if(full || (mask & PICO_CHANGED_US_C))
+	{
+		writeU16(&payload[length], frame->Ultrasonic_C_Raw);
+		length += 2;
+	}
+	if(full || (mask & PICO_CHANGED_US_R))
+	{
+		writeU16(&payload[length], frame->Ultrasonic_R_Raw);
+		length += 2;
+	}
+	// ultrasonic values in mm, and the temperature they were converted at (always sent)
+	if(full || (mask & PICO_CHANGED_US_L))
+	{
+		writeU16(&payload[length], frame->Ultrasonic_L_Distance);
+		length += 2;
+	}
+	if(full || (mask & PICO_CHANGED_US_C))
+	{
+		writeU16(&payload[length], frame->Ultrasonic_C_Distance);
+		length += 2;
+	}
+	if(full || (mask & PICO_CHANGED_US_R))
+	{
+		writeU16(&payload[length], frame->Ultrasonic_R_Distance);
+		length += 2;
+	}
+	// two's complement bits as they are, writeU16 would clamp a negative temperature to 0
+	writeU16(&payload[length], (unsigned int)frame->Temperature);
+	length += 2;
+	// bump counts since the last frame and the dropped event total
+	if(full || (mask & PICO_CHANGED_BUMPS))
+	{
+		payload[length++] = frame->Bump_L_Count;
+		payload[length++] = frame->Bump_R_Count;
+		writeU16(&payload[length], frame->Events_Dropped);
+		length += 2;
+	}
+	// calibrated weight, two's complement bits as they are (same as the temperature)
+	if(full || (mask & PICO_CHANGED_WEIGHT))
+	{
+		writeU16(&payload[length], (unsigned int)frame->Weight_Grams);
+		length += 2;
+	}
+	// battery voltage, always sent
+	writeU16(&payload[length], frame->Battery_Voltage);
+	length += 2;
+
+	// CRC-16/XMODEM over the payload, appended little endian
+	for(i = 0; i < length; ++i)
+	{
+		crc = _crc_xmodem_update(crc, payload[i]);
+	}
+	payload[length++] = (unsigned char)crc;
+	payload[length++] = (unsigned char)(crc >> 8);
+
+	// stuff out the zeros, then terminate with the delimiter the pico resyncs on
+	length = cobsEncode(encoded, payload, length);
+	encoded[length++] = 0x00;
+
+	return SCI0_TxQueueData(encoded, length);
+}
+
+unsigned char computeChangeMask(struct PicoFrame * frame)
+{
+	unsigned char mask = 0;
+
+	// nothing to compare against yet, everything is new
+	if(!lastFrameValid)
+	{
+		return 0xFF;
+	}
+
+	// range sensors count as changed if either their filtered or unfiltered value did
+	if(frame->IR_L_Distance != lastFrame.IR_L_Distance || frame->IR_L_Raw != lastFrame.IR_L_Raw)
+		mask |= PICO_CHANGED_IR_L;
+	if(frame->IR_R_Distance != lastFrame.IR_R_Distance || frame->IR_R_Raw != lastFrame.IR_R_Raw)
+		mask |= PICO_CHANGED_IR_R;
+	// (the mm values also move with the temperature)
+	if(frame->Ultrasonic_L_Duration != lastFrame.Ultrasonic_L_Duration || frame->Ultrasonic_L_Raw != lastFrame.Ultrasonic_L_Raw
+		|| frame->Ultrasonic_L_Distance != lastFrame.Ultrasonic_L_Distance)
+		mask |= PICO_CHANGED_US_L;
+	if(frame->Ultrasonic_C_Duration != lastFrame.Ultrasonic_C_Duration || frame->Ultrasonic_C_Raw != lastFrame.Ultrasonic_C_Raw
+		|| frame->Ultrasonic_C_Distance != lastFrame.Ultrasonic_C_Distance)
+		mask |= PICO_CHANGED_US_C;
+	if(frame->Ultrasonic_R_Duration != lastFrame.Ultrasonic_R_Duration || frame->Ultrasonic_R_Raw != lastFrame.Ultrasonic_R_Raw
+		|| frame->Ultrasonic_R_Distance != lastFrame.Ultrasonic_R_Distance)
+		mask |= PICO_CHANGED_US_R;
+	// (counts start over every frame, so any press at all is news)
+	if(frame->Bump_L != lastFrame.Bump_L || frame->Bump_R != lastFrame.Bump_R
+		|| frame->Bump_L_Count || frame->Bump_R_Count || frame->Events_Dropped != lastFrame.Events_Dropped)
+		mask |= PICO_CHANGED_BUMPS;
+	if(frame->Weight_Fine != lastFrame.Weight_Fine || frame->Weight_Grams != lastFrame.Weight_Grams)
+		mask |= PICO_CHANGED_WEIGHT;
+	if(frame->Motor_FL_Direction != lastFrame.Motor_FL_Direction
+		|| frame->Motor_FR_Direction != lastFrame.Motor_FR_Direction
+		|| frame->Motor_FL_Speed != lastFrame.Motor_FL_Speed
+		|| frame->Motor_FR_Speed != lastFrame.Motor_FR_Speed)
+		mask |= PICO_CHANGED_ENCODERS;
+
+	return mask;
+}
+
+void writeU16(unsigned char * dest, long value)
+{
+	// clamp into what 16 bits can carry rather than wrapping
+	unsigned int clamped = value > 0xFFFF ? 0xFFFF : (value < 0 ? 0 : (unsigned int)value);
+	dest[0] = (unsigned char)clamped;
+	dest[1] = (unsigned char)(clamped >> 8);
+}
+
+unsigned char cobsEncode(unsigned char * dest, const unsigned char * src, unsigned char len)
+{
+	// position of the code byte for the current block
+	unsigned char codeIndex = 0;
+	unsigned char code = 1;
+	unsigned char out = 1;
+
+	while(len--)
+	{
+		if(*src)
+		{
+			dest[out++] = *src;
+			++code;
+		}
+		// a zero (or a full block) closes the current block
+		if(!*src || code == 0xFF)
+		{
+			dest[codeIndex] = code;
+			codeIndex = out++;
+			code = 1;
+		}
+		++src;
+	}
+	dest[codeIndex] = code;
+
+	return out;
+}
+
+void runCommand(char command, unsigned int argument, struct PicoSettings * settings)
+{
+	unsigned char channel;
+
+	TRACE(Trace_Command, command);
+	switch(command)
+	{
+		case 'P':
+			// a zero period would send frames back to back, don't allow it
+			if(argument)
+			{
+				settings->FramePeriod = argument;
+			}
+			break;
+		case 'E':
+			settings->SensorEnable = (unsigned char)argument;
+			break;
+		case 'R':
+			settings->ReadRequest |= (unsigned char)argument;
+			break;
+		case 'F':
+			if(argument == Pico_FrameFormat_ASCII || argument == Pico_FrameFormat_Binary)
+			{
+				Pico_SetFrameFormat((Pico_FrameFormat)argument);
+			}
+			break;
+		case 'D':
+			Pico_SetDeltaFrames((unsigned char)argument);
+			break;
+		case 'G':
+			// no guard at all would fire the next ping straight into the last one's echo
+			if(argument)
+			{
+				settings->UltrasonicGuard = argument;
+			}
+			break;
+		case 'A':
+			settings->UltrasonicSettle = argument;
+			break;
+		case 'W':
+			// one channel per sensor bit, b7 (IR L) down to b3 (US R)
+			for(channel = 0; channel < PICO_RANGE_CHANNELS; ++channel)
+			{
+				if((argument >> 8) & (PICO_SENSOR_IR_L >> channel))
+				{
+					settings->RangeFilter[channel] = (unsigned char)argument;
+				}
+			}
+			break;
+		case 'L':
+			// every frame at the most, there's no such thing as less often than never here
+			if(argument)
+			{
+				settings->WeightPeriod = (unsigned char)argument;
+			}
+			break;
+		case 'Z':
+			// and a weight right away, so the pico sees the new zero
+			settings->TareRequest = 1;
+			settings->ReadRequest |= PICO_SENSOR_WEIGHT;
+			break;
+#ifdef TRACE_ENABLED
+		case 'T':
+			// the dump is ASCII lines, it can't share the port with binary frames
+			if(frameFormat == Pico_FrameFormat_ASCII)
+			{
+				TRACE_DUMP();
+			}
+			break;
+#endif
+		default:
+			// unknown command, ignore
+			break;
+	}
 }
\ No newline at end of file
@@ -12,8 +12,9 @@ $FFFFF1FFFF1FFFF1FFFFA3FF1FFFFF^
 The above is broken up into 16 segments varying in the number of (string) bytes that represent them.
 
 Segment 1: (2 bytes)
-Indication of which of the 8 sensors have changed.
+Indication of which of the 8 sensors have changed since the last frame that was sent.
 The values that are indicated as being modified are the next 7 segments (segment 9 is excluded since it is just a battery indicator)
+The first frame after power up flags everything. Encoders covers segments 10 through 12.
 
 * ---------------------------------------------------------------------------------------------
 * |    b7    |    b6    |     b5    |    b4    |     b3     |   b2    |    b1    |     b0     |
@@ -33,16 +34,19 @@ Segment 4: (5 bytes)
 Left Ultrasonic Sensor
 Values 00000-1FFFF
 A measure of counts (in 0.5us?) that it took the echo to send and receive (needs to be / 2)
+0FFFF means no echo came back before the deadline (nothing in range, or a sensor fault)
 
 Segment 5: (5 bytes)
 Center Ultrasonic Sensor
 Values 00000-1FFFF
 A measure of counts (in 0.5us?) that it took the echo to send and receive (needs to be / 2)
+0FFFF means no echo came back before the deadline (nothing in range, or a sensor fault)
 
 Segment 6: (5 bytes)
 Right Ultrasonic Sensor
 Values 00000-1FFFF
 A measure of counts (in 0.5us?) that it took the echo to send and receive (needs to be / 2)
+0FFFF means no echo came back before the deadline (nothing in range, or a sensor fault)
 
 Segment 7: (1 byte)
 Left and Right Bump Sensor
@@ -65,9 +69,12 @@ The values are chosen as the bit values represent the last 2 bits of the hex val
 Segment 8: (3 bytes)
 Weight (force sensing resistor)
 A raw AtoD value, from a 10 bit ADC, representing the voltage measured between 0 and 5V, where 5V = 10N (max force)
+(the MCU oversamples it, the full 12 bits are in segment 39)
 
-Segment 9: (1 or 3 bytes)
-Battery level (if 1 byte, is 0/1; if 3 bytes, is an AtoD value similar to segment 8)
+Segment 9: (3 bytes)
+Battery voltage in 10mV (000-FFF, so up to 40.95V), worked out on the MCU from the internal bandgap
+(the supply voltage, or the battery itself through a divider if the board has one). Always sent.
+The low battery flag is in segment 38.
 
 Segment 10: (2 bytes)
 Direction of Motors (from encoders)
@@ -103,14 +110,277 @@ Measured in RPMs, max possible value is 255, though it should never be above 170
 Segment 16: (2 byte) -- not in use
 Speed of Back Left Motor (from encoders)
 Measured in RPMs, max possible value is 255, though it should never be above 170
+
+Segments 13 through 16 are not sent. The timing segments below follow segment 12 (before the end byte).
+Segment 9 grew to 3 bytes and is always sent (it used to be a single byte, only there when the battery
+was low), so segments 1 through 12 take PICO_FRAME_LENGTH (34) characters. Counting from 0 after the '$':
+1 at 0, 2 at 2, 3 at 4, 4 at 6, 5 at 11, 6 at 16, 7 at 21, 8 at 22, 9 at 25, 10 at 28, 11 at 30, 12 at 32.
+Segments 1 through 8 are where they always were, 10 through 12 moved 3 characters later.
+All times are in timer ticks (0.5ms, the same timebase that paces frames) from a free running 16 bit
+counter, so they wrap every ~32.7s.
+
+Segment 17: (2 bytes)
+Sequence number, 00-FF, incremented for every frame (including any the transmit queue had to drop)
+
+Segment 18: (4 bytes)
+Frame time, when the frame was put together
+
+Segment 19: (4 bytes)
+Left IR Sensor capture time
+
+Segment 20: (4 bytes)
+Right IR Sensor capture time
+
+Segment 21: (4 bytes)
+Left Ultrasonic Sensor capture time
+
+Segment 22: (4 bytes)
+Center Ultrasonic Sensor capture time
+
+Segment 23: (4 bytes)
+Right Ultrasonic Sensor capture time
+
+Segment 24: (4 bytes)
+Weight capture time
+
+Segments 2 through 6 carry the range sensors after the MCU's median/Hampel filter (see the W command).
+The unfiltered values follow segment 24, in the same format as their filtered segments.
+
+Segment 25: (2 bytes)
+Left IR Sensor, unfiltered
+
+Segment 26: (2 bytes)
+Right IR Sensor, unfiltered
+
+Segment 27: (5 bytes)
+Left Ultrasonic Sensor, unfiltered
+
+Segment 28: (5 bytes)
+Center Ultrasonic Sensor, unfiltered
+
+Segment 29: (5 bytes)
+Right Ultrasonic Sensor, unfiltered
+
+Segments 30 through 32 are the filtered ultrasonic values converted to mm on the MCU, corrected for the
+air temperature in segment 33. Values 0000-FFFE mm, FFFF means no echo.
+
+Segment 30: (4 bytes)
+Left Ultrasonic Sensor, mm
+
+Segment 31: (4 bytes)
+Center Ultrasonic Sensor, mm
+
+Segment 32: (4 bytes)
+Right Ultrasonic Sensor, mm
+
+Segment 33: (4 bytes)
+Air temperature (LM75A) the mm values were worked out with, in 1/8 degrees C, signed (two's complement)
+
+Segment 7 is the bump state when the frame was put together, a contact that came and went in between
+frames only shows up in the counts below. Every debounced press is counted, anything shorter than the
+debounce time is noise and isn't.
+
+Segment 34: (2 bytes)
+Left bump switch presses since the last frame, 00-FF (stops at FF)
+
+Segment 35: (2 bytes)
+Right bump switch presses since the last frame, 00-FF (stops at FF)
+
+Segment 36: (4 bytes)
+Switch events dropped because the MCU's event queue was full, a running total (wraps at FFFF),
+any increase means the counts above may be short
+
+Segment 37: (4 bytes)
+Weight in grams, segment 39 through the MCU's calibration curve less the tare (Z command),
+signed (two's complement), so it can go a little negative after a tare
+
+Segment 38: (1 byte)
+Battery low, 0/1. Set once segment 9 drops below the low threshold and only cleared once it's back
+above a higher one, so it doesn't flicker with the load. Always sent.
+
+Segment 39: (3 bytes)
+Weight, the same AtoD value as segment 8 before it's cut down to 10 bits, 12 bits (000-FFF, the 10 bit ADC
+oversampled 16 times)
+
+
+Weight events (Pico_SendWeightEvent)
+Sent on their own as soon as the MCU's detector sees the weight settle after a change, between frames.
+&TTGGGGSSSS^ followed by a new line:
+ TT   (2 bytes) event, 01 = placed (went from empty to loaded), 02 = removed (loaded to empty),
+      03 = changed (still loaded, settled at a different weight, eg. pills taken out)
+ GGGG (4 bytes) settled weight in grams less the tare, signed, same as segment 37
+ SSSS (4 bytes) time it settled, in timer ticks like the timing segments
+With events covering the transitions, the weight in frames can be slowed down (L command).
+
+
+Delta frames (Pico_SetDeltaFrames)
+Off by default. When enabled, a full frame (above) is sent every N frames and the frames in between
+start with '#' instead of '$' and only contain segment 1 plus the segments it flags as changed,
+in the usual order. Segment 9 follows the same rule as a full frame. Encoders (b0) covers 10 through 12.
+Segments 17, 18, 33 and 38 are always sent, and each capture time (19-24), unfiltered value (25-29) and mm
+value (30-32) is only sent with its own segment. Segments 34-36 are sent with segment 7 (b2), which is
+flagged whenever a press was counted or an event dropped, and segments 37 and 39 with segment 8 (b1). A range sensor is flagged as changed if any of its
+values changed.
+A delta frame with nothing changed is just #00, 17 and 18, and still acts as a heartbeat.
+
+
+Binary frame format (Pico_FrameFormat_Binary)
+Selected at runtime with Pico_SetFrameFormat, ASCII above remains the default.
+A 53 byte payload followed by a CRC-16/XMODEM (poly 0x1021, init 0x0000) of the payload,
+the whole 55 bytes COBS encoded and terminated with a 0x00 delimiter (57 bytes on the wire).
+Times are the same as the ASCII timing segments (17-24), and range values are filtered unless noted.
+COBS guarantees the encoded data has no zeros, so the pico can always resync on the next 0x00.
+Multi-byte values are little endian.
+
+* ---------------------------------------------------------------------------------------------
+* |  Byte(s)  |  Contents                                                                      |
+* ---------------------------------------------------------------------------------------------
+* |     0     |  Changed sensors, same bits as segment 1                                       |
+* |     1     |  Sequence number                                                               |
+* |    2-3    |  Frame time                                                                    |
+* |     4     |  Left IR Sensor, mm                                                            |
+* |    5-6    |  Left IR Sensor capture time                                                   |
+* |     7     |  Right IR Sensor, mm                                                           |
+* |    8-9    |  Right IR Sensor capture time                                                  |
+* |   10-11   |  Left Ultrasonic Sensor, us (saturates, FFFF = no echo)                        |
+* |   12-13   |  Left Ultrasonic Sensor capture time                                           |
+* |   14-15   |  Center Ultrasonic Sensor, us (saturates, FFFF = no echo)                      |
+* |   16-17   |  Center Ultrasonic Sensor capture time                                         |
+* |   18-19   |  Right Ultrasonic Sensor, us (saturates, FFFF = no echo)                       |
+* |   20-21   |  Right Ultrasonic Sensor capture time                                          |
+* |   22-23   |  Weight, raw AtoD value (12 bits, same as segment 39)                          |
+* |   24-25   |  Weight capture time                                                           |
+* |     26    |  Flags, see below                                                              |
+* |     27    |  Speed of Front Left Motor, RPM                                                |
+* |     28    |  Speed of Front Right Motor, RPM                                               |
+* |     29    |  Left IR Sensor, mm, unfiltered                                                |
+* |     30    |  Right IR Sensor, mm, unfiltered                                               |
+* |   31-32   |  Left Ultrasonic Sensor, us, unfiltered                                        |
+* |   33-34   |  Center Ultrasonic Sensor, us, unfiltered                                      |
+* |   35-36   |  Right Ultrasonic Sensor, us, unfiltered                                       |
+* |   37-38   |  Left Ultrasonic Sensor, mm (FFFF = no echo)                                   |
+* |   39-40   |  Center Ultrasonic Sensor, mm (FFFF = no echo)                                 |
+* |   41-42   |  Right Ultrasonic Sensor, mm (FFFF = no echo)                                  |
+* |   43-44   |  Air temperature, 1/8 degrees C, signed                                        |
+* |     45    |  Left bump switch presses since the last frame (stops at FF)                   |
+* |     46    |  Right bump switch presses since the last frame (stops at FF)                  |
+* |   47-48   |  Switch events dropped, running total (same as segment 36)                     |
+* |   49-50   |  Weight, grams less the tare, signed (same as segment 37)                      |
+* |   51-52   |  Battery voltage, mV                                                           |
+* |   53-54   |  CRC-16/XMODEM of bytes 0-52                                                   |
+* ---------------------------------------------------------------------------------------------
+
+Binary delta frames leave out the fields not flagged in byte 0 (with their capture times), keeping the
+order above. Bytes 0-3 and the flags byte are always present, and encoders (b0) covers the two speed
+bytes, and each unfiltered and mm value goes with its filtered field. The temperature is always present.
+Bytes 45-48 go with the bumps bit (b2), the bump state itself is in the flags byte and always present.
+Bytes 49-50 go with the weight bit (b1), and the battery voltage is always present.
+A full frame is always 53 bytes before the CRC and a delta frame is shorter unless every field changed (in which case the two
+are identical), so the decoded length tells them apart.
+A weight event is its own COBS packet with a 5 byte payload (event, grams, time, same as the ASCII event,
+little endian) and CRC. No frame is shorter than 7 bytes, so the length tells an event apart too.
+
+Flags byte (motor direction bits line up with segment 10):
+* ----------------------------------------------------------------------------------------
+* |   b7  |  b6   |   b5    |    b4     |     b3     |     b2      |    b1    |     b0    |
+* ----------------------------------------------------------------------------------------
+* |     unused    | Front L |  Front R  |   unused   | Battery Low |  Bump L  |  Bump R   |
+* ----------------------------------------------------------------------------------------
+
+
+Commands (pico to MCU)
+Received in the background by the RX interrupt and acted on by Pico_ReceiveData.
+Each command is '!', a command letter, 1-4 hex digits of argument, then '^' (eg. !P00C8^).
+A '!' always starts a new command, and anything malformed or unknown is ignored.
+Sensor masks use the same bits as segment 1.
+The ultrasonic sensors are pinged in turn in the background, so for them E only picks which sensors are
+pinged, and R sends the latest values for those. A disabled one named in R gets a one-shot slot of its
+own, and the frame waits for it to come back (up to 100ms). The same goes for the right IR sensor, which
+ranges continuously while it's enabled (R on its own, with it disabled, still takes a single reading).
+
+* ---------------------------------------------------------------------------------------------
+* |  Command  |  Argument                                                                      |
+* ---------------------------------------------------------------------------------------------
+* |     P     |  Frame period, in timer ticks (0.5ms), 0001-FFFF                               |
+* |     E     |  Sensors to read every frame period (00-FF)                                    |
+* |     R     |  Sensors to read once, right away, followed by a frame (00-FF)                 |
+* |     F     |  Frame format, 0 = ASCII, 1 = binary                                           |
+* |     D     |  Delta frame keyframe interval, 00 = delta frames off                          |
+* |     W     |  Range filter, high byte = sensors (IR/US bits), low byte = filter:            |
+* |           |  b7 1 = Hampel (only replace outliers) 0 = median, b3-0 window 1-9 samples     |
+* |           |  (0 or 1 = unfiltered), eg. !W3887^ = 7 sample Hampel on all 3 US sensors      |
+* |     G     |  Time between ultrasonic pings, in timer counts (0.5us), 0001-FFFF             |
+* |     A     |  Ultrasonic settle time after an echo comes back, in timer counts (0.5us),     |
+* |           |  the next ping goes out after it instead of the full G time, 0000 = fixed rate |
+* |     T     |  Send the trace buffer (debug builds and ASCII format only, see lib/trace.h)   |
+* |     L     |  Weight in every Nth periodic frame (01-FF), 01 = every frame (default),       |
+* |           |  weight events still go out as they happen                                     |
+* |     Z     |  Tare, whatever is on the weight sensor now reads 0 grams, then a frame        |
+* |           |  with the weight (argument ignored)                                            |
+* ---------------------------------------------------------------------------------------------
 */
 
-#define PICO_FRAME_LENGTH      31  // not inclusive of start/end bytes
+#define PICO_FRAME_LENGTH      34  // segments 1-12, not inclusive of start/end bytes
+#define PICO_TIMING_LENGTH     30  // segments 17-24, on top of PICO_FRAME_LENGTH
 #define PICO_START_BYTE		   '$' // indicator of a start frame
 #define PICO_END_BYTE          '^' // indicator of an end frame
+#define PICO_DELTA_START_BYTE  '#' // indicator of a start frame carrying only changed segments
+#define PICO_EVENT_START_BYTE  '&' // indicator of the start of a weight event
+#define PICO_EVENT_BINARY_LENGTH 5 // weight event payload, not inclusive of CRC, COBS overhead or delimiter
 
 #define PICO_BAUD_RATE 56000
 
+// bits of the segment 1 change mask
+#define PICO_CHANGED_IR_L       0b10000000
+#define PICO_CHANGED_IR_R       0b01000000
+#define PICO_CHANGED_US_L       0b00100000
+#define PICO_CHANGED_US_C       0b00010000
+#define PICO_CHANGED_US_R       0b00001000
+#define PICO_CHANGED_BUMPS      0b00000100
+#define PICO_CHANGED_WEIGHT     0b00000010
+#define PICO_CHANGED_ENCODERS   0b00000001
+
+// sensor bits for the E and R commands, same layout as the change mask
+#define PICO_SENSOR_IR_L        PICO_CHANGED_IR_L
+#define PICO_SENSOR_IR_R        PICO_CHANGED_IR_R
+#define PICO_SENSOR_US_L        PICO_CHANGED_US_L
+#define PICO_SENSOR_US_C        PICO_CHANGED_US_C
+#define PICO_SENSOR_US_R        PICO_CHANGED_US_R
+#define PICO_SENSOR_BUMPS       PICO_CHANGED_BUMPS
+#define PICO_SENSOR_WEIGHT      PICO_CHANGED_WEIGHT
+#define PICO_SENSOR_ENCODERS    PICO_CHANGED_ENCODERS
+
+#define PICO_CMD_START_BYTE    '!' // indicator of the start of a command from the pico
+#define PICO_CMD_MAX_DIGITS    4   // hex digits allowed in a command argument
+
+#define PICO_BINARY_PAYLOAD_LENGTH 53 // not inclusive of CRC, COBS overhead or delimiter
+#define PICO_RAW_LENGTH        19  // segments 25-29, on top of PICO_TIMING_LENGTH
+#define PICO_MM_LENGTH         16  // segments 30-33, on top of PICO_RAW_LENGTH
+#define PICO_EVENT_LENGTH      8   // segments 34-36, on top of PICO_MM_LENGTH
+#define PICO_GRAMS_LENGTH      5   // segments 37-38, on top of PICO_EVENT_LENGTH
+#define PICO_FINE_LENGTH       3   // segment 39, on top of PICO_GRAMS_LENGTH
+
+// bits of the binary frame flags byte
+#define PICO_FLAG_BUMP_R        0b00000001
+#define PICO_FLAG_BUMP_L        0b00000010
+#define PICO_FLAG_BATTERY_LOW   0b00000100
+#define PICO_FLAG_MOTOR_FR_FWD  0b00010000
+#define PICO_FLAG_MOTOR_FL_FWD  0b00100000
+
+// range sensor channels in PicoSettings.RangeFilter, in segment 1 bit order
+#define PICO_RANGE_IR_L         0
+#define PICO_RANGE_IR_R         1
+#define PICO_RANGE_US_L         2
+#define PICO_RANGE_US_C         3
+#define PICO_RANGE_US_R         4
+#define PICO_RANGE_CHANNELS     5
+
+typedef enum
+{
+	Pico_FrameFormat_ASCII = 0,  // hex segments between '$' and '^' (default)
+	Pico_FrameFormat_Binary = 1  // COBS framed binary payload with CRC-16
+} Pico_FrameFormat;
+
 struct PicoFrame {
     unsigned char IR_L_Distance;         //measured in mm
     unsigned char IR_R_Distance;         //measured in mm
@@ -122,9 +392,11 @@ struct PicoFrame {
     char Bump_L;                // 1 if there's an object
     char Bump_R;                // 1 if there's an object
 
-    int  Weight;                // AD value measured (5V ref)
+    int  Weight;                // AD value measured (5V ref), 10 bits
+    int  Weight_Fine;           // the same value before it's cut down to 10 bits, 12 bits
 
     char Battery_Low;           // 1 if battery low
+    unsigned int Battery_Voltage; // mV
 
     char Motor_FL_Direction;    // 1 if forward
     unsigned char Motor_FL_Speed;        // measured in RPM
@@ -143,12 +415,72 @@ struct PicoFrame {
 
     // char Motor_BR_Direction;    // 1 if forward
     // unsigned char Motor_BR_Speed;        // measured in RPM
+
+    unsigned char Sequence;             // rolling frame counter, filled in by Pico_SendData
+    unsigned int Frame_Time;            // timer ticks (0.5ms) when the frame was put together
+
+    unsigned int IR_L_Time;             // timer ticks (0.5ms) when each value was captured
+    unsigned int IR_R_Time;
+    unsigned int Ultrasonic_L_Time;
+    unsigned int Ultrasonic_C_Time;
+    unsigned int Ultrasonic_R_Time;
+    unsigned int Weight_Time;
+
+    unsigned char IR_L_Raw;             // same as the values above, before the range filter
+    unsigned char IR_R_Raw;
+    long Ultrasonic_L_Raw;
+    long Ultrasonic_C_Raw;
+    long Ultrasonic_R_Raw;
+
+    unsigned int Ultrasonic_L_Distance; // filtered values above in mm, temperature corrected (FFFF = no echo)
+    unsigned int Ultrasonic_C_Distance;
+    unsigned int Ultrasonic_R_Distance;
+    int Temperature;                    // 1/8 degrees C the mm values were worked out with
+
+    unsigned char Bump_L_Count;         // presses since the last frame (saturates), cleared once it's sent
+    unsigned char Bump_R_Count;
+    unsigned int Events_Dropped;        // running total of events the queue had no room for (event.h)
+
+    int Weight_Grams;                   // Weight through the calibration curve, less the tare
+};
+
+// Runtime settings the pico can change through commands, owned by main
+struct PicoSettings {
+    unsigned int FramePeriod;            // timer ticks between frames
+    unsigned char SensorEnable;          // sensors read every frame period (PICO_SENSOR_ bits)
+    unsigned char ReadRequest;           // sensors to read once, cleared by main once handled
+    unsigned int UltrasonicGuard;        // timer counts (0.5us) between scheduled ultrasonic pings
+    unsigned int UltrasonicSettle;       // timer counts (0.5us) after an echo before the next ping, 0 = fixed rate
+    unsigned char RangeFilter[PICO_RANGE_CHANNELS]; // range filter config (RANGE_FILTER_ bits) per PICO_RANGE_ channel
+    unsigned char TareRequest;           // 1 to tare the weight, cleared by main once handled
+    unsigned char WeightPeriod;          // weight in every Nth periodic frame (1 = every frame)
 };
 
 
 // initialize the pico to run on UART
 void Pico_InitCommunication(void);
-// Function to run to receive data. Not currently used
-void Pico_ReceiveData(void);
-// Send a request to the pico via uart
-void Pico_SendData(struct PicoFrame frame);
+// Handle any commands received from the pico, updating settings (never waits for data)
+void Pico_ReceiveData(struct PicoSettings * settings);
+// Send a frame to the pico via uart (queued, returns without waiting for the transmit)
+// zero on frame queued, otherwise the transmit queue was full and it was dropped
+int Pico_SendData(struct PicoFrame frame);
+
+// Send a weight event to the pico right away, in the current wire format (queued, never waits)
+// event is a GD03_EventType, time in timer ticks (0.5ms) like the frame times
+// zero on event queued, otherwise the transmit queue was full and it was dropped
+int Pico_SendWeightEvent(unsigned char event, int grams, unsigned int time);
+
+#ifdef TRACE_ENABLED
+// Queue as much of a trace dump (T command) as the transmit queue has room for, never waits
+// The dump is ASCII lines (see lib/trace.h), so switching to the binary format abandons it
+void Pico_SendTrace(void);
+#endif
+
+// Select the wire format used by Pico_SendData
+void Pico_SetFrameFormat(Pico_FrameFormat format);
+
+// Wire format currently used by Pico_SendData
+Pico_FrameFormat Pico_GetFrameFormat(void);
+
+// Send only changed segments, with a full keyframe every interval frames (0 = always full frames)
+void Pico_SetDeltaFrames(unsigned char interval);
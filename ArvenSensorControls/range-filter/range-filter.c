@@ -0,0 +1,125 @@
+/*
+ * range_filter.c
+ *
+ * Created: 2026-10-17
+ */
+#include "range-filter.h"
+
+/************************************************************************/
+/* Local Definitions (private functions)                                */
+/************************************************************************/
+
+// Take the oldest sample out of the sorted list (if the window is full) and put the new one in its place,
+// shifting only the entries between the two, so each sample costs at most one pass of the window
+void updateSorted(struct RangeFilter * filter, unsigned int oldest, unsigned int sample);
+
+// Median absolute deviation of the window from median
+unsigned int medianDeviation(struct RangeFilter * filter, unsigned int median);
+
+
+/************************************************************************/
+/* Header Implementation                                                */
+/************************************************************************/
+
+void RangeFilter_Init(struct RangeFilter * filter, unsigned char config)
+{
+	filter->Window = config & RANGE_FILTER_WINDOW;
+	if(filter->Window > RANGE_FILTER_MAX_WINDOW)
+	{
+		filter->Window = RANGE_FILTER_MAX_WINDOW;
+	}
+	filter->Hampel = (config & RANGE_FILTER_HAMPEL) != 0;
+	filter->Count = 0;
+	filter->Next = 0;
+	filter->Value = 0;
+}
+
+unsigned int RangeFilter_Add(struct RangeFilter * filter, unsigned int sample)
+{
+	unsigned int median;
+	unsigned int deviation;
+	unsigned long threshold;
+
+	// nothing to filter with
+	if(filter->Window < 2)
+	{
+		filter->Value = sample;
+		return sample;
+	}
+
+	// swap the oldest sample out of the ring for the new one
+	updateSorted(filter, filter->Samples[filter->Next], sample);
+	filter->Samples[filter->Next] = sample;
+	if(++filter->Next >= filter->Window)
+	{
+		filter->Next = 0;
+	}
+
+	median = filter->Sorted[filter->Count / 2];
+	if(!filter->Hampel)
+	{
+		filter->Value = median;
+		return median;
+	}
+
+	// Hampel, keep the sample unless it sits too many deviations away from the median
+	deviation = sample > median ? sample - median : median - sample;
+	threshold = (unsigned long)medianDeviation(filter, median) * RANGE_FILTER_HAMPEL_NUM / RANGE_FILTER_HAMPEL_DEN;
+	filter->Value = deviation > threshold ? median : sample;
+	return filter->Value;
+}
+
+
+/************************************************************************/
+/* Local  Implementation                                                */
+/************************************************************************/
+
+void updateSorted(struct RangeFilter * filter, unsigned int oldest, unsigned int sample)
+{
+	unsigned char i;
+
+	if(filter->Count < filter->Window)
+	{
+		// still filling, just open up a spot at the end
+		i = filter->Count++;
+	}
+	else
+	{
+		// find the oldest sample, any copy of the value will do
+		for(i = 0; i < filter->Count - 1 && filter->Sorted[i] != oldest; ++i);
+	}
+
+	// slide the hole towards where the new sample belongs
+	while(i > 0 && filter->Sorted[i - 1] > sample)
+	{
+		filter->Sorted[i] = filter->Sorted[i - 1];
+		--i;
+	}
+	while(i < filter->Count - 1 && filter->Sorted[i + 1] < sample)
+	{
+		filter->Sorted[i] = filter->Sorted[i + 1];
+		++i;
+	}
+	filter->Sorted[i] = sample;
+}
+
+unsigned int medianDeviation(struct RangeFilter * filter, unsigned int median)
+{
+	unsigned int deviations[RANGE_FILTER_MAX_WINDOW];
+	unsigned char i;
+	unsigned char j;
+
+	// insertion sort, the window is never more than a handful of samples
+	for(i = 0; i < filter->Count; ++i)
+	{
+		unsigned int value = filter->Sorted[i];
+		unsigned int deviation = value > median ? value - median : median - value;
+
+		for(j = i; j > 0 && deviations[j - 1] > deviation; --j)
+		{
+			deviations[j] = deviations[j - 1];
+		}
+		deviations[j] = deviation;
+	}
+	return deviations[filter->Count / 2];
+}
@@ -0,0 +1,37 @@
+/*
+ * range_filter.h
+ * Median / Hampel outlier filter for the range sensors
+ * Integer only, one filter per channel
+ *
+ * Created: 2026-10-17
+ */
+
+// most samples a filter can hold, the window is set per filter up to this
+#define RANGE_FILTER_MAX_WINDOW 9
+
+// config byte for RangeFilter_Init (same as the pico W command)
+#define RANGE_FILTER_WINDOW     0b00001111 // samples in the window, 0 or 1 passes samples straight through
+#define RANGE_FILTER_HAMPEL     0b10000000 // 1 = Hampel (only replace outliers), 0 = plain median
+
+// Hampel outlier threshold, in MADs (median absolute deviation) scaled to a standard deviation,
+// 3 * 1.4826 ~= 89 / 20
+#define RANGE_FILTER_HAMPEL_NUM 89
+#define RANGE_FILTER_HAMPEL_DEN 20
+
+struct RangeFilter {
+	unsigned int Samples[RANGE_FILTER_MAX_WINDOW]; // ring of the most recent samples, in arrival order
+	unsigned int Sorted[RANGE_FILTER_MAX_WINDOW];  // the same samples, kept in ascending order
+	unsigned char Window;                          // samples the filter covers
+	unsigned char Count;                           // samples held so far, up to Window
+	unsigned char Next;                            // ring position the next sample goes in (the oldest once full)
+	char Hampel;                                   // 1 for Hampel, 0 for median
+	unsigned int Value;                            // last filtered value
+};
+
+// Clear the filter and set its window and mode (RANGE_FILTER_ bits)
+void RangeFilter_Init(struct RangeFilter * filter, unsigned char config);
+
+// Add a sample and return the filtered value. Median returns the median of the window, Hampel returns the
+// sample itself unless it is further from the median than the threshold above, then the median instead.
+// A lone error value (eg. 0 or 255 from the IR sensors) is dropped either way once the window holds 3+ samples
+unsigned int RangeFilter_Add(struct RangeFilter * filter, unsigned int sample);
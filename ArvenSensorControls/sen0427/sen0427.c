@@ -5,10 +5,16 @@
  * Author: Kia Skretteberg & Nubal Manhas
  */
 #include <avr/io.h>
+#include <avr/interrupt.h>
 #include "i2c.h"
+#include "pcint.h"
+#include "timer.h"
 #include "sen0427.h"
 #include "../mcp23017/mcp23017.h"
 
+// not on this robot, leave the whole driver out
+#if BOARD_SEN0427
+
 /************************************************************************/
 /* Local Definitions (private functions)                                */
 /************************************************************************/
@@ -25,6 +31,35 @@ uint8_t getDeviceAddr(SEN0427_Device device);
 // assigns the new, proper address to the device, using the default address as the intended write device
 void reAddressDevice(SEN0427_Device device);
 
+// read the range once it's ready, 255 on a range error, then clear the interrupt
+unsigned char readSample(SEN0427_Device device);
+
+// GPIO1 pin and port of the device, 0 pin if not a device
+unsigned char intPin(SEN0427_Device device);
+unsigned char intPort(SEN0427_Device device);
+
+// Pin change handler for GPIO1, see PCINT_Handler
+void intEdge(unsigned char changed, unsigned char level);
+
+#define SEN0427_DEVICE_COUNT 2
+// most convergence time the sensor is set up with (VL6180X_SYSRANGE_MAX_CONVERGENCE_TIME), ms
+#define SEN0427_MAX_CONVERGENCE_MS 49
+// a single measurement is given up on this long after it's started, the max convergence time plus ~6ms
+// of the sensor's own overhead, in Timer_Now counts (0.5us, timer 1 at prescale 8)
+#define SEN0427_SINGLE_TIMEOUT ((SEN0427_MAX_CONVERGENCE_MS + 6) * 2000UL)
+
+/************************************************************************/
+/* Global Variables                                                     */
+/************************************************************************/
+
+// bit per device, set by the pin change ISR when GPIO1 goes low, cleared when the sample is picked up
+volatile unsigned char sampleReady = 0;
+// Timer_Now when each device's GPIO1 went low
+volatile unsigned long sampleTime[SEN0427_DEVICE_COUNT];
+// bit per device with a pin change handler registered (only ever once) and ranging continuously
+unsigned char intRegistered = 0;
+unsigned char continuousRunning = 0;
+
 /************************************************************************/
 /* Header Implementation                                                */
 /************************************************************************/
@@ -33,11 +68,11 @@ void reAddressDevice(SEN0427_Device device);
 void SEN0427_InitAll(void)
 {
     //Set pin to low
-	PORTD &= ~SEN0427_L_EN;
+	BOARD_PORT_REG(BOARD_SEN0427_L_EN_PORT) &= ~SEN0427_L_EN;
 	// initialize the right sensor	
     (void) SEN0427_InitDevice(SEN0427_R);
     // set the pin high to enable SEN0427_L
-	PORTD |= SEN0427_L_EN;
+	BOARD_PORT_REG(BOARD_SEN0427_L_EN_PORT) |= SEN0427_L_EN;
     // initialize the left sensor
     (void) SEN0427_InitDevice(SEN0427_L);
 }
@@ -96,10 +131,12 @@ int SEN0427_InitDevice(SEN0427_Device device)
     write8bit(device, VL6180X_SYSRANGE_VHV_REPEAT_RATE, 0xFF);
     write8bit(device, VL6180X_SYSRANGE_VHV_RECALIBRATE, 0x01);
     write8bit(device, VL6180X_SYSRANGE_INTERMEASUREMENT_PERIOD, 0x09);
-    write8bit(device, VL6180X_SYSTEM_INTERRUPT_CONFIG_GPIO, 0x00);
-    write8bit(device, VL6180X_SYSRANGE_MAX_CONVERGENCE_TIME, 0x31);
+    // flag every new range sample, in the status register and on GPIO1
+    write8bit(device, VL6180X_SYSTEM_INTERRUPT_CONFIG_GPIO, VL6180X_NEW_SAMPLE_READY);
+    write8bit(device, VL6180X_SYSRANGE_MAX_CONVERGENCE_TIME, SEN0427_MAX_CONVERGENCE_MS);
     write8bit(device, 0x2A3, 0);
-    write8bit(device, VL6180X_SYSTEM_MODE_GPIO1,0x20);
+    write8bit(device, VL6180X_SYSTEM_MODE_GPIO1, VL6180X_GPIO1_INTERRUPT_LOW);
+    write8bit(device, VL6180X_SYSTEM_INTERRUPT_CLEAR, VL6180X_CLEAR_ALL_INTERRUPTS);
     write8bit(device, VL6180X_SYSTEM_FRESH_OUT_OF_RESET,0);           
 
     return 0;
@@ -113,17 +150,64 @@ SEN0427_RangeResult SEN0427_GetRangeResult(SEN0427_Device device)
 
 unsigned char SEN0427_GetSingleMeasurement(SEN0427_Device device)
 {
+    unsigned long started;
+
+    // anything left over would look like this measurement being done already
+    write8bit(device, VL6180X_SYSTEM_INTERRUPT_CLEAR, VL6180X_CLEAR_ALL_INTERRUPTS);
     write8bit(device, VL6180X_SYSRANGE_START, 0b01);
-    return SEN0427_ReadRangeMeasurement(device);
+    started = Timer_Now();
+    // the range register isn't valid until the sample ready interrupt is up
+    while((read8bit(device, VL6180X_RESULT_INTERRUPT_STATUS_GPIO) & 0x07) != VL6180X_NEW_SAMPLE_READY)
+    {
+        if(Timer_Now() - started >= SEN0427_SINGLE_TIMEOUT)
+        {
+            return 255;
+        }
+    }
+    return readSample(device);
 }
 
-void SEN0427_StartContinuousMeasurement(SEN0427_Device device)
+int SEN0427_StartContinuousMeasurement(SEN0427_Device device)
 {
+    unsigned char pin = intPin(device);
+    unsigned char port = intPort(device);
+
+    if(!pin)
+    {
+        return -1;
+    }
+
+    // GPIO1 is open drain, pulled up here (input, pull-up on)
+    BOARD_DDR_REG(port) &= ~pin;
+    BOARD_PORT_REG(port) |= pin;
+    if(!(intRegistered & (1 << device)))
+    {
+        if(PCINT_Register((PCINT_Port)port, pin, intEdge))
+        {
+            return -1;
+        }
+        intRegistered |= 1 << device;
+    }
+
+    // start from nothing pending, so the first sample is a fresh falling edge
+    write8bit(device, VL6180X_SYSTEM_INTERRUPT_CLEAR, VL6180X_CLEAR_ALL_INTERRUPTS);
+    sampleReady &= ~(1 << device);
+    PCINT_Enable((PCINT_Port)port, pin);
     write8bit(device, VL6180X_SYSRANGE_START, 0b11);
+    continuousRunning |= 1 << device;
+    return 0;
 }
+
 void SEN0427_StopContinuousMeasurement(SEN0427_Device device)
 {
-    write8bit(device, VL6180X_SYSRANGE_START, 0b10);
+    // start/stop bit toggles continuous ranging, only write it if it's actually running
+    if(!(continuousRunning & (1 << device)))
+    {
+        return;
+    }
+    write8bit(device, VL6180X_SYSRANGE_START, 0b01);
+    continuousRunning &= ~(1 << device);
+    PCINT_Disable((PCINT_Port)intPort(device), intPin(device));
 }
 
 unsigned char SEN0427_ReadRangeMeasurement(SEN0427_Device device)
@@ -133,19 +217,34 @@ unsigned char SEN0427_ReadRangeMeasurement(SEN0427_Device device)
 
 unsigned char SEN0427_CaptureDistance(SEN0427_Device device)
 {
-    unsigned char distance = 255; //default to 255, max distance, to indicate error
+    // the status that goes with this measurement only exists once it's done, GetSingleMeasurement checks it
+    return SEN0427_GetSingleMeasurement(device);
+}
 
-    switch(SEN0427_GetRangeResult(device))
+char SEN0427_SampleReady(SEN0427_Device device)
+{
+    unsigned char pin = intPin(device);
+
+    // the line stays low until the clear, so a low pin counts too (eg. an edge from before the handler was on)
+    return pin && ((sampleReady & (1 << device)) || !(BOARD_PIN_REG(intPort(device)) & pin));
+}
+
+int SEN0427_PollSample(SEN0427_Device device, unsigned char * distance, unsigned long * time)
+{
+    if(!SEN0427_SampleReady(device))
     {
-        case SEN0427_RangeResult__NO_ERR:
-            distance = SEN0427_GetSingleMeasurement(device);
-            break;
-		default:
-			// DO NOTHING FOR ERRORS
-			break;
+        return -1;
     }
 
-    return distance;
+    // 32 bit time from the ISR, and the flag dropped before the clear so the next edge sets it again
+    unsigned char sreg = SREG;
+    cli();
+    *time = (sampleReady & (1 << device)) ? sampleTime[device] : Timer_Now();
+    sampleReady &= ~(1 << device);
+    SREG = sreg;
+
+    *distance = readSample(device);
+    return 0;
 }
 
 /************************************************************************/
@@ -188,6 +287,56 @@ unsigned char read8bit(SEN0427_Device device, uint16_t registerAddr)
     return data;
 }
 
+unsigned char readSample(SEN0427_Device device)
+{
+    unsigned char distance = 255; //default to 255, max distance, to indicate error
+
+    switch(SEN0427_GetRangeResult(device))
+    {
+        case SEN0427_RangeResult__NO_ERR:
+            distance = SEN0427_ReadRangeMeasurement(device);
+            break;
+		default:
+			// DO NOTHING FOR ERRORS
+			break;
+    }
+    // done with this sample, GPIO1 goes back up until the next one
+    write8bit(device, VL6180X_SYSTEM_INTERRUPT_CLEAR, VL6180X_CLEAR_ALL_INTERRUPTS);
+
+    return distance;
+}
+
+unsigned char intPin(SEN0427_Device device)
+{
+    switch(device)
+    {
+        case SEN0427_L:
+            return SEN0427_L_INT;
+        case SEN0427_R:
+            return SEN0427_R_INT;
+        default:
+            return 0;
+    }
+}
+
+unsigned char intPort(SEN0427_Device device)
+{
+    return device == SEN0427_L ? BOARD_SEN0427_L_INT_PORT : BOARD_SEN0427_R_INT_PORT;
+}
+
+void intEdge(unsigned char changed, unsigned char level)
+{
+    // only the falling edge is a new sample, going back up is just the clear
+    for(SEN0427_Device device = SEN0427_L; device < SEN0427_DEVICE_COUNT; ++device)
+    {
+        if((changed & intPin(device)) && !(level & intPin(device)))
+        {
+            sampleTime[device] = Timer_Now();
+            sampleReady |= 1 << device;
+        }
+    }
+}
+
 uint8_t getDeviceAddr(SEN0427_Device device)
 {
     uint8_t deviceAddr = 0;
@@ -203,4 +352,6 @@ uint8_t getDeviceAddr(SEN0427_Device device)
 			break;
 	}
     return deviceAddr;
-}
\ No newline at end of file
+}
+
+#endif
@@ -1,7 +1,7 @@
 /*
  * sen0427.h
  * VL6180X IR Sensor(s) Module
- * Utilizes I2C
+ * Utilizes I2C, and the pin change dispatcher (pcint.h) and Timer1 timebase (timer.h) for continuous ranging
  *
  * Created: 2023-02-25
  * Author: Kia Skretteberg & Nubal Manhas
@@ -11,10 +11,17 @@
 #define SEN0427_Addr	0x29 // default, will need to change in initialize
 #define SEN0427_L_Addr	0x30
 #define SEN0427_R_Addr	0x31
-#define SEN0427_L_EN 0b00010000
+#include "../board.h"
+
+#define SEN0427_L_EN BOARD_SEN0427_L_EN // from the board profile
+// GPIO1 of each sensor, pulled low on every new continuous sample until it's cleared
+#define SEN0427_L_INT BOARD_SEN0427_L_INT
+#define SEN0427_R_INT BOARD_SEN0427_R_INT
 
 #define VL6180X_SYSTEM_MODE_GPIO0                     0X010
 #define VL6180X_SYSTEM_MODE_GPIO1                     0X011
+// SYSTEM_MODE_GPIO1 bits 4-1 = 1000 for the interrupt output, bit 5 = 0 for active low (open drain)
+#define VL6180X_GPIO1_INTERRUPT_LOW                   0x10
 
 /* Interrupt mode source for Range readings[bit:2-0]:
     0: Disabled
@@ -33,6 +40,7 @@
 #define VL6180X_NEW_SAMPLE_READY     4
 
 #define VL6180X_SYSTEM_INTERRUPT_CLEAR                0x015 // set bit 0 to 1 in order to clear interrupt for range
+#define VL6180X_CLEAR_ALL_INTERRUPTS                  0x07  // range, ALS and error
 #define VL6180X_SYSTEM_FRESH_OUT_OF_RESET             0x016
 #define VL6180X_SYSTEM_GROUPED_PARAMETER_HOLD         0x017
 #define VL6180X_SYSRANGE_START                        0x018 // bit 0 (1 = start, 0 = stop) -- stop only used for continuous
@@ -52,8 +60,8 @@
 // #define VL6180X_SYSRANGE_RANGE_CHECK_ENABLES          0x02D
 #define VL6180X_SYSRANGE_VHV_RECALIBRATE              0x02E
 #define VL6180X_SYSRANGE_VHV_REPEAT_RATE              0x031
-// #define VL6180X_RESULT_INTERRUPT_STATUS_GPIO          0x04F
-//#define VL6180X_RESULT_RANGE_VAL                      0x062 // implicitly trunated????? 
+#define VL6180X_RESULT_INTERRUPT_STATUS_GPIO          0x04F // bits 2-0, range interrupt that's pending (same values as the config)
+#define VL6180X_RESULT_RANGE_VAL                      0x062 // register addresses are 16 bits (read8bit), nothing's truncated
 
 
 
@@ -109,16 +117,30 @@ int SEN0427_InitDevice(SEN0427_Device device);
 // Returns the status of the current range measurement
 SEN0427_RangeResult SEN0427_GetRangeResult(SEN0427_Device device);
 
-// Retrieve a single measurement from the specified device
+// Retrieve a single measurement from the specified device, waits for it to converge (up to the max
+// convergence time plus overhead, ~55ms), 255 on a range error or if it never does
+// (Timer_Init and Timer_InitNow first, for the deadline)
 unsigned char SEN0427_GetSingleMeasurement(SEN0427_Device device);
 
-void SEN0427_StartContinuousMeasurement(SEN0427_Device device);
+// Range continuously at the intermeasurement period, each new sample pulls the device's GPIO1 low
+// (requires ISR for the pin's PCINT group), pick them up with SEN0427_PollSample
+// zero on started, otherwise no pin change handler could be registered for the interrupt
+int SEN0427_StartContinuousMeasurement(SEN0427_Device device);
 
 void SEN0427_StopContinuousMeasurement(SEN0427_Device device);
 
-// Should only be called manually after calling SEN0427_StartContinuousMeasurement,
-// automatically called by GetSingleMeasurement
+// Range register as it is, whatever state the measurement is in
+// (SEN0427_PollSample and SEN0427_GetSingleMeasurement only read it once it's ready)
 unsigned char SEN0427_ReadRangeMeasurement(SEN0427_Device device);
 
-// check the range result and return the distance if not an error
-unsigned char SEN0427_CaptureDistance(SEN0427_Device device);
\ No newline at end of file
+// Start a single measurement and return the distance, 255 on a range error
+unsigned char SEN0427_CaptureDistance(SEN0427_Device device);
+
+// 1 if a continuous sample is waiting to be picked up (no I2C, a pin check)
+char SEN0427_SampleReady(SEN0427_Device device);
+
+// Pick up the continuous sample the device signalled, if any: reads it (255 on a range error) and then
+// clears the interrupt, so each sample is read exactly once. time is Timer_Now when GPIO1 went low
+// Uses the I2C bus, nothing else can be mid transaction
+// zero on sample read, otherwise there's nothing new
+int SEN0427_PollSample(SEN0427_Device device, unsigned char * distance, unsigned long * time);
\ No newline at end of file
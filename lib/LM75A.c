@@ -54,3 +54,96 @@ float LM75A_GetTempF ()
 }
 
 
+
+// states for the non-blocking read, each waits on TWINT (or the stop) before moving on
+typedef enum
+{
+  LM75A_Idle,
+  LM75A_WaitStart,
+  LM75A_WaitAddr,
+  LM75A_WaitHigh,
+  LM75A_WaitLow,
+  LM75A_WaitStop
+} LM75A_ReadState;
+
+static volatile LM75A_ReadState _ReadState = LM75A_Idle;
+static unsigned char _ReadHigh;
+static unsigned char _ReadLow;
+
+int LM75A_StartRead (void)
+{
+  if (_ReadState != LM75A_Idle)
+    return -1;
+
+  // send start
+  TWCR = 0b10100100;
+  _ReadState = LM75A_WaitStart;
+  return 0;
+}
+
+int LM75A_PollTemp (int * eighths)
+{
+  // stop is the only step not flagged by TWINT
+  if (_ReadState == LM75A_WaitStop)
+  {
+    if (TWCR & 0x10)
+      return 1;
+    _ReadState = LM75A_Idle;
+    // left-aligned 11 bits, an arithmetic shift keeps the sign
+    *eighths = (int)(((unsigned int)_ReadHigh << 8) + _ReadLow) >> 5;
+    return 0;
+  }
+
+  if (_ReadState == LM75A_Idle)
+    return -1;
+
+  // current step still on the bus
+  if (!(TWCR & 0x80))
+    return 1;
+
+  switch (_ReadState)
+  {
+    case LM75A_WaitStart:
+      // ensure status says START sent
+      if ((TWSR & 0b11111000) != 0x08)
+        break;
+      // enter master read mode
+      TWDR = (0x48 << 1) | 0x01;
+      TWCR = 0b10000100;
+      _ReadState = LM75A_WaitAddr;
+      return 1;
+    case LM75A_WaitAddr:
+      // look for ADDR+R sent with ACK
+      if ((TWSR & 0b11111000) != 0x40)
+        break;
+      // read temperature data byte high, ack more data please
+      TWCR = 0b11000100;
+      _ReadState = LM75A_WaitHigh;
+      return 1;
+    case LM75A_WaitHigh:
+      if ((TWSR & 0b11111000) != 0x50)
+        break;
+      _ReadHigh = TWDR;
+      // read temperature data byte low, nack no more data please
+      TWCR = 0b10000100;
+      _ReadState = LM75A_WaitLow;
+      return 1;
+    case LM75A_WaitLow:
+      if ((TWSR & 0b11111000) != 0x58)
+        break;
+      _ReadLow = TWDR;
+      // send STOP
+      TWCR = 0b10010100;
+      _ReadState = LM75A_WaitStop;
+      return 1;
+    default:
+      break;
+  }
+
+  // failed somewhere, send STOP so the bus isn't left held for the next transaction
+  TWCR = 0b10010100;
+  while (TWCR & 0x10)
+    ;
+  _ReadState = LM75A_Idle;
+  return -2;
+}
@@ -11,4 +11,15 @@ int LM75A_ReadTemp (unsigned int * uiTemp);
 
 // use read temp to convert to an actual temperature
 //  returns -300 if I2C error
-float LM75A_GetTempF ();
\ No newline at end of file
+float LM75A_GetTempF ();
+
+// start reading the temperature without waiting on the bus, finish it with LM75A_PollTemp
+// reads straight from the pointer register's power up default (temperature), which nothing here changes
+// the bus is tied up until the read finishes, don't start another I2C transaction before then
+//  returns -1 if a read is already going
+int LM75A_StartRead (void);
+
+// move a read started with LM75A_StartRead along as far as the bus allows, never waits
+// when done, *eighths is the temperature in 1/8 degrees C (signed, same resolution as the device)
+//  returns 1 while still reading, 0 when done, negative on I2C error (bus is released)
+int LM75A_PollTemp (int * eighths);
@@ -2,6 +2,18 @@
 // Simon Walker, NAIT
 // Revision History:
 // May 5 2022 - Initial Build
+// October 17 2026 - Interrupt driven channel scan with oversampling
+// October 17 2026 - Scan paced by timer 0 compare A through the auto trigger
+// October 17 2026 - Reference per scan channel
+
+// what the scan ISR should look like (copy to implementation)
+/*
+ISR (ADC_vect)
+{
+  // take the finished conversion and start the next one
+  AtoD_ScanISR();
+}
+*/
 
 typedef enum AtoD_Channel
 {
@@ -20,4 +32,74 @@ typedef enum AtoD_Channel
 
 void AtoD_Init (AtoD_Channel chan);
 
-void AtoD_SetChannel (AtoD_Channel chan);
\ No newline at end of file
+void AtoD_SetChannel (AtoD_Channel chan);
+
+// reference voltage, ADMUX REFS1:REFS0 (28.9.1)
+// (an external voltage on AREF rules out the internal ones, they'd be shorted to it)
+typedef enum AtoD_Reference
+{
+  AtoD_Ref_AREF = 0,   // AREF pin (what AtoD_Init uses)
+  AtoD_Ref_AVcc = 1,   // AVcc, with a capacitor on AREF
+  AtoD_Ref_1V1  = 3    // internal 1.1V, with a capacitor on AREF
+} AtoD_Reference;
+
+// most channels in a scan list
+#ifndef ATOD_SCAN_MAX_CHANNELS
+#define ATOD_SCAN_MAX_CHANNELS 4
+#endif
+
+// most oversampling, 4^3 = 64 samples of 10 bits still fit the 16 bit sum
+#define ATOD_SCAN_MAX_OVERSAMPLE 3
+
+// conversions thrown away after the scan switches reference, for the capacitor on AREF to charge to the
+// new one (a channel switch on the same reference only throws one away)
+#ifndef ATOD_SCAN_REF_DISCARD
+#define ATOD_SCAN_REF_DISCARD 4
+#endif
+
+// shortest trigger period, in timer 0 counts (4us at prescale 64)
+// an auto triggered conversion is 13.5 AtoD clocks (108us at prescale 128), a trigger during one is lost
+#define ATOD_SCAN_MIN_PERIOD 28
+
+// Timer_Now counts (timer 1 at prescale 8) from the trigger to the end of the conversion, taken off
+// Timer_Now in the ISR to stamp each sample with when it was triggered (13.5 AtoD clocks of 16 counts)
+#ifndef ATOD_SCAN_CONVERSION_COUNTS
+#define ATOD_SCAN_CONVERSION_COUNTS 216
+#endif
+
+// one entry in the scan list
+struct AtoD_ScanChannel
+{
+  AtoD_Channel Channel;
+  unsigned char Oversample;  // n, 4^n samples summed and decimated to 10 + n bits (0-3)
+  AtoD_Reference Reference;  // what it's converted against, the scan switches as it goes
+};
+
+// latest result for a channel
+struct AtoD_ScanResult
+{
+  unsigned int Value;        // 10 + n bits
+  unsigned char Sequence;    // goes up by one every new result (skipping 0), so a caller can tell whether it's seen it
+  unsigned long Time;        // Timer_Now when the last of its samples was triggered
+};
+
+// start converting the channels in the background, in turn and forever (requires ISR for ADC_vect)
+// period is timer 0 counts (4us) between conversions, ATOD_SCAN_MIN_PERIOD-255: timer 0 runs in CTC
+// mode and its compare A starts each conversion through the auto trigger, so samples are evenly spaced
+// whatever the CPU is doing (timer 0 is taken, no Timer_F_PWM0 alongside). 0 starts each conversion from
+// the ISR instead, as fast as the AtoD goes (104us) but with the ISR latency as jitter
+// each result is 4^n samples, so a channel is published every 4^n + 1 conversions
+// (the first after switching channels is thrown away so the input can settle, ATOD_SCAN_REF_DISCARD after
+// switching references)
+// AREF can't share a list with the internal references: if AREF is driven they'd be shorted to it, and if
+// it only has its capacitor there's nothing to convert against
+// zero on scan started, otherwise the list, an oversample count, a reference or the period was out of range
+// (Timer_Init and Timer_InitNow first, for the sample times)
+int AtoD_ScanInit (const struct AtoD_ScanChannel * channels, unsigned char count, unsigned char period);
+
+// latest result for the channel at index in the scan list, never waits
+// zero on result read, otherwise no result for that index yet
+int AtoD_ScanRead (unsigned char index, struct AtoD_ScanResult * result);
+
+// call from ADC_vect, takes the finished conversion (and starts the next one when not timer triggered)
+void AtoD_ScanISR (void);
@@ -3,7 +3,40 @@
 
 #include <avr/io.h>
 #include <stdio.h>
+#include <avr/interrupt.h>
 #include "atd.h"
+#include "timer.h"
+
+// scan list and where the ISR is in it
+static struct AtoD_ScanChannel _ScanChannels[ATOD_SCAN_MAX_CHANNELS];
+static volatile unsigned char _ScanCount = 0;
+static volatile unsigned char _ScanIndex = 0;
+// running sum for the current channel, and how many samples it still needs
+static volatile unsigned int _ScanSum = 0;
+static volatile unsigned char _ScanRemaining = 0;
+// conversions left to throw away after a channel or reference switch
+static volatile unsigned char _ScanDiscard = 0;
+// conversions started by timer 0 (otherwise by the ISR)
+static volatile unsigned char _ScanTriggered = 0;
+
+// published results, written by the ISR only
+// the sequence goes up after every write, main re-reads if it moved halfway through (no cli needed)
+static volatile unsigned int _ScanResult[ATOD_SCAN_MAX_CHANNELS];
+static volatile unsigned long _ScanTime[ATOD_SCAN_MAX_CHANNELS];
+static volatile unsigned char _ScanSequence[ATOD_SCAN_MAX_CHANNELS];
+
+// point the mux (and reference) at the channel at index and get its sum started
+// the first conversions after are thrown away while it settles, more if the reference moved
+static void ScanSelect (unsigned char index)
+{
+  unsigned char admux = (_ScanChannels[index].Reference << 6) | _ScanChannels[index].Channel;
+
+  _ScanDiscard = (admux ^ ADMUX) & 0b11000000 ? ATOD_SCAN_REF_DISCARD : 1;
+  _ScanIndex = index;
+  _ScanSum = 0;
+  _ScanRemaining = 1 << (2 * _ScanChannels[index].Oversample);
+  ADMUX = admux;        // right-aligned (28.9.1)
+}
 
 void AtoD_Init (AtoD_Channel chan)
 {
@@ -53,4 +86,146 @@ void AtoD_SetChannel (AtoD_Channel chan)
   // channel selection
   ADMUX &= 0b11110000;  // clear channel selection
   ADMUX |= chan;        // set back channel selection bits
-}
\ No newline at end of file
+}
+
+int AtoD_ScanInit (const struct AtoD_ScanChannel * channels, unsigned char count, unsigned char period)
+{
+  unsigned char i;
+  unsigned char aref = 0;
+
+  if (!count || count > ATOD_SCAN_MAX_CHANNELS || (period && period < ATOD_SCAN_MIN_PERIOD))
+    return -1;
+  for (i = 0; i < count; ++i)
+  {
+    if (channels[i].Oversample > ATOD_SCAN_MAX_OVERSAMPLE)
+      return -1;
+    switch (channels[i].Reference)
+    {
+      case AtoD_Ref_AREF:
+        aref |= 1;
+        break;
+      case AtoD_Ref_AVcc:
+      case AtoD_Ref_1V1:
+        aref |= 2;
+        break;
+      default:
+        return -1;
+    }
+  }
+  // never switch an internal reference onto AREF
+  if (aref == 3)
+    return -1;
+
+  ADCSRA = 0;           // stop anything in progress (free running from AtoD_Init) before the ISR owns it
+  PRR &= ~(1 << PRADC); // turn on A/D module in power reduction register
+
+  DIDR0 = 0;
+  for (i = 0; i < count; ++i)
+  {
+    _ScanChannels[i] = channels[i];
+    _ScanSequence[i] = 0;
+    // kill digital input on the pins being converted (internal channels don't have one)
+    if (channels[i].Channel <= AtoD_Channel_7)
+      DIDR0 |= 1 << channels[i].Channel;
+  }
+  _ScanCount = count;
+
+  // reference (and the mux) may have just changed, ScanSelect sets up the discards
+  ScanSelect(0);
+  _ScanTriggered = period != 0;
+
+  if (!_ScanTriggered)
+  {
+    ADCSRB = 0b00000000;  // no auto trigger source needed, each conversion is started by the ISR
+    ADCSRA = 0b11001111;  // turn on AD, start, single conversion, interrupt, prescale 128 (28.9.2)
+    return 0;
+  }
+
+  // ensure power is on : Timer 0
+  PRR &= ~(1 << PRTIM0);
+  TCCR0B = 0;           // stopped while it's set up
+  TCCR0A = 0b00000010;  // CTC (mode 2), no output pins, clears at OCR0A (15.9.1)
+  OCR0A = period - 1;
+  TCNT0 = 0;
+  TIMSK0 = 0;           // no timer 0 interrupts, the compare flag only has to reach the AtoD
+  TIFR0 = 1 << OCF0A;
+
+  ADCSRB = 0b00000011;  // auto trigger source, timer 0 compare match A (28.9.4)
+  ADCSRA = 0b10101111;  // turn on AD, auto trigger, interrupt, prescale 128 (28.9.2)
+  TCCR0B = 0b00000011;  // prescale 64, 4us counts, go (15.9.2)
+
+  return 0;
+}
+
+int AtoD_ScanRead (unsigned char index, struct AtoD_ScanResult * result)
+{
+  unsigned char before;
+  unsigned char after;
+  unsigned int value;
+  unsigned long time;
+
+  if (index >= _ScanCount)
+    return -1;
+
+  // multi-byte result from the ISR, read until it holds still for the whole read
+  do
+  {
+    before = _ScanSequence[index];
+    value = _ScanResult[index];
+    time = _ScanTime[index];
+    after = _ScanSequence[index];
+  } while (before != after);
+
+  if (!after)
+    return -1;
+
+  result->Value = value;
+  result->Sequence = after;
+  result->Time = time;
+  return 0;
+}
+
+void AtoD_ScanISR (void)
+{
+  unsigned int sample = ADC; // ADCL then ADCH
+
+  // the auto trigger fires on the compare flag going up, it has to come down again before the next one
+  // (nothing else clears it, timer 0's interrupt is off) (28.4)
+  if (_ScanTriggered)
+    TIFR0 = 1 << OCF0A;
+
+  if (_ScanDiscard)
+  {
+    --_ScanDiscard;
+  }
+  else
+  {
+    _ScanSum += sample;
+    if (!--_ScanRemaining)
+    {
+      // 4^n samples carry n extra bits (with the noise doing the dithering), shift off the other n
+      _ScanResult[_ScanIndex] = _ScanSum >> _ScanChannels[_ScanIndex].Oversample;
+      // a conversion always takes the same time, so this is when it was triggered (give or take the ISR latency)
+      _ScanTime[_ScanIndex] = Timer_Now() - ATOD_SCAN_CONVERSION_COUNTS;
+      // 0 means nothing published yet, so skip it on the way around
+      if (!++_ScanSequence[_ScanIndex])
+        _ScanSequence[_ScanIndex] = 1;
+
+      if (_ScanCount > 1)
+      {
+        // first conversion after the switch is off (the bandgap especially needs time to settle)
+        ScanSelect(_ScanIndex + 1 < _ScanCount ? _ScanIndex + 1 : 0);
+      }
+      else
+      {
+        // same channel and reference, nothing to settle
+        ScanSelect(0);
+        _ScanDiscard = 0;
+      }
+    }
+  }
+
+  // start the next one, unless timer 0 is going to
+  if (!_ScanTriggered)
+    ADCSRA |= 1 << ADSC;
+}
@@ -0,0 +1,63 @@
+// Event queue library, ISRs to main
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "event.h"
+
+// head written by the producer (ISRs), tail by the consumer (main)
+static volatile struct Event _EventBuff[EVENT_QUEUE_SIZE];
+static volatile unsigned char _EventHead = 0;
+static volatile unsigned char _EventTail = 0;
+static volatile unsigned int _EventDropped = 0;
+
+#define EVENT_QUEUE_MASK (EVENT_QUEUE_SIZE - 1)
+
+int Event_Post (Event_Type type, unsigned char source, unsigned long time)
+{
+	unsigned char head = _EventHead;
+	unsigned char next = (head + 1) & EVENT_QUEUE_MASK;
+
+	// one slot is always left empty so full and empty can be told apart
+	if (next == _EventTail)
+	{
+		++_EventDropped;
+		return -1;
+	}
+
+	// filled in before the head moves, so main never sees half an event
+	_EventBuff[head].Type = type;
+	_EventBuff[head].Source = source;
+	_EventBuff[head].Time = time;
+	_EventHead = next;
+
+	return 0;
+}
+
+int Event_Get (struct Event * event)
+{
+	unsigned char tail = _EventTail;
+
+	if (tail == _EventHead)
+		return -1;
+
+	event->Type = _EventBuff[tail].Type;
+	event->Source = _EventBuff[tail].Source;
+	event->Time = _EventBuff[tail].Time;
+	// copied out before the slot is handed back to the producer
+	_EventTail = (tail + 1) & EVENT_QUEUE_MASK;
+
+	return 0;
+}
+
+unsigned int Event_Dropped (void)
+{
+	unsigned int dropped;
+
+	// 16 bits updated from ISRs
+	unsigned char sreg = SREG;
+	cli();
+	dropped = _EventDropped;
+	SREG = sreg;
+
+	return dropped;
+}
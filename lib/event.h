@@ -0,0 +1,40 @@
+// Event queue library, ISRs to main
+// Revision History:
+// October 17 2026 - Initial Build
+
+// Typed, timestamped events from ISRs, held in order until the main loop gets to them, so
+// something that comes and goes between two main loop passes (or frames) is never lost.
+// Lock free, single producer / single consumer: the producers are ISRs, which never nest on
+// the AVR so they count as one, and only the main loop takes events out. 8-bit indices let
+// each side read the other's without a critical section (same as the SCI queues).
+// A full queue drops the new event and counts it, what's already queued is never overwritten
+
+// number of events held, must be a power of 2 (max 128), 6 bytes each
+#ifndef EVENT_QUEUE_SIZE
+#define EVENT_QUEUE_SIZE 16
+#endif
+
+// event types
+typedef enum
+{
+	Event_BumpPress = 1,    // source: bump switch (0 = left, 1 = right), time: first edge
+	Event_BumpRelease = 2   // source: bump switch (0 = left, 1 = right), time: first edge
+} Event_Type;
+
+struct Event
+{
+	unsigned char Type;     // Event_Type
+	unsigned char Source;   // which device, meaning depends on the type
+	unsigned long Time;     // Timer_Now counts (0.5us) when it happened
+};
+
+// queue an event, call from ISRs only (main would be a second producer)
+// zero on event queued, otherwise the queue was full and it was dropped (and counted)
+int Event_Post (Event_Type type, unsigned char source, unsigned long time);
+
+// take the oldest event off the queue, call from main only
+// zero on event read, otherwise the queue is empty
+int Event_Get (struct Event * event);
+
+// number of events dropped because the queue was full (wraps at FFFF)
+unsigned int Event_Dropped (void);
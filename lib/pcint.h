@@ -0,0 +1,48 @@
+// Pin change interrupt library, ATmega328P Version
+// Shared by every driver with a pin on a PCINT group, works out which pins actually
+// changed and only calls the handlers registered for them
+
+// what the ISRs should look like (copy to implementation), one per group in use
+/*
+ISR (PCINT0_vect)
+{
+	PCINT_ISR(PCINT_PortB);
+}
+
+ISR (PCINT2_vect)
+{
+	PCINT_ISR(PCINT_PortD);
+}
+*/
+
+// most handlers on one port
+#ifndef PCINT_MAX_HANDLERS
+#define PCINT_MAX_HANDLERS 4
+#endif
+
+// port (and pin change group) a pin is on
+typedef enum
+{
+	PCINT_PortB = 0, // PCINT0-7, PCMSK0
+	PCINT_PortC = 1, // PCINT8-14, PCMSK1
+	PCINT_PortD = 2  // PCINT16-23, PCMSK2
+} PCINT_Port;
+
+#define PCINT_PORT_COUNT 3
+
+// called from the ISR with the handler's pins that changed, and the whole port as read in the ISR
+// (a pin in changed that is high in level went up, low went down)
+typedef void (*PCINT_Handler)(unsigned char changed, unsigned char level);
+
+// turn on pin change interrupts for pins (and the group they're in), from their current level
+void PCINT_Enable (PCINT_Port port, unsigned char pins);
+
+// turn off pin change interrupts for pins, the group stays on
+void PCINT_Disable (PCINT_Port port, unsigned char pins);
+
+// call handler whenever any of pins changes, pins still have to be enabled
+// zero on registered, otherwise the port already has PCINT_MAX_HANDLERS
+int PCINT_Register (PCINT_Port port, unsigned char pins, PCINT_Handler handler);
+
+// call from PCINTn_vect for the port's group
+void PCINT_ISR (PCINT_Port port);
@@ -0,0 +1,96 @@
+// Pin change interrupt library, ATmega328P Version
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "pcint.h"
+
+// port levels as of the last ISR (or enable), XOR'd with the new read to find what changed
+static volatile unsigned char _PCINTLast[PCINT_PORT_COUNT];
+
+// registered handlers and their pins, per port
+static PCINT_Handler _PCINTHandlers[PCINT_PORT_COUNT][PCINT_MAX_HANDLERS];
+static unsigned char _PCINTPins[PCINT_PORT_COUNT][PCINT_MAX_HANDLERS];
+static unsigned char _PCINTCount[PCINT_PORT_COUNT];
+
+static unsigned char PCINTRead (PCINT_Port port)
+{
+	switch (port)
+	{
+		case PCINT_PortB:
+			return PINB;
+		case PCINT_PortC:
+			return PINC;
+		case PCINT_PortD:
+			return PIND;
+		default:
+			return 0;
+	}
+}
+
+static volatile unsigned char * PCINTMask (PCINT_Port port)
+{
+	switch (port)
+	{
+		case PCINT_PortB:
+			return &PCMSK0;
+		case PCINT_PortC:
+			return &PCMSK1;
+		default:
+			return &PCMSK2;
+	}
+}
+
+void PCINT_Enable (PCINT_Port port, unsigned char pins)
+{
+	if (port >= PCINT_PORT_COUNT)
+		return;
+
+	// snapshot and mask have to agree, or the ISR sees a change that never happened
+	unsigned char sreg = SREG;
+	cli();
+	_PCINTLast[port] = (_PCINTLast[port] & ~pins) | (PCINTRead(port) & pins);
+	*PCINTMask(port) |= pins;	// pin mask (12.2.4 - 12.2.8)
+	PCICR |= 1 << port;			// group enable (12.2.4)
+	SREG = sreg;
+}
+
+void PCINT_Disable (PCINT_Port port, unsigned char pins)
+{
+	if (port >= PCINT_PORT_COUNT)
+		return;
+
+	*PCINTMask(port) &= ~pins;
+}
+
+int PCINT_Register (PCINT_Port port, unsigned char pins, PCINT_Handler handler)
+{
+	if (port >= PCINT_PORT_COUNT || _PCINTCount[port] >= PCINT_MAX_HANDLERS)
+		return -1;
+
+	// filled in before it's counted, so the ISR never sees half an entry
+	unsigned char sreg = SREG;
+	cli();
+	_PCINTHandlers[port][_PCINTCount[port]] = handler;
+	_PCINTPins[port][_PCINTCount[port]] = pins;
+	++_PCINTCount[port];
+	SREG = sreg;
+
+	return 0;
+}
+
+void PCINT_ISR (PCINT_Port port)
+{
+	unsigned char level = PCINTRead(port);
+	// only pins that are enabled and actually moved, every other pin on the port is ignored
+	unsigned char changed = (level ^ _PCINTLast[port]) & *PCINTMask(port);
+
+	_PCINTLast[port] = level;
+	if (!changed)
+		return;
+
+	for (unsigned char i = 0; i < _PCINTCount[port]; ++i)
+	{
+		if (changed & _PCINTPins[port][i])
+			_PCINTHandlers[port][i](changed & _PCINTPins[port][i], level);
+	}
+}
@@ -15,6 +15,35 @@ ISR (USART_RX_vect)
 }
 */
 
+// what the transmit ISR should look like (copy to implementation)
+/*
+ISR (USART_UDRE_vect)
+{
+  // feed the next queued byte to the transmitter
+  SCI0_TxISR();
+}
+*/
+
+// what the queued receive ISR should look like (copy to implementation)
+// (SCI0_Init with bRXInt set, then read with SCI0_RxQueueByte)
+/*
+ISR (USART_RX_vect)
+{
+  // pull the byte into the receive queue (clears the interrupt too)
+  SCI0_RxISR();
+}
+*/
+
+// size of the interrupt driven receive queue, must be a power of 2 (max 128)
+#ifndef SCI0_RX_BUFFER_SIZE
+#define SCI0_RX_BUFFER_SIZE 32
+#endif
+
+// size of the interrupt driven transmit queue, must be a power of 2 (max 128)
+#ifndef SCI0_TX_BUFFER_SIZE
+#define SCI0_TX_BUFFER_SIZE 128
+#endif
+
 // initialize UCSR0 for asynchronous use, 8N1, at specified BAUD rate
 int SCI0_Init (unsigned long ulBus, unsigned long ulBAUD, int bRXInt);
 
@@ -29,3 +58,34 @@ void SCI0_Tx16H (unsigned int uiVal, int tl);
 
 // zero on byte rxed, otherwise no byte to read
 int SCI0_RxByte (unsigned char * pData);
+
+// non-blocking send of a byte through the transmit queue
+// zero on byte queued, otherwise queue full and the byte was dropped
+int SCI0_TxQueueByte (unsigned char data);
+
+// non-blocking send of a string through the transmit queue
+// all or nothing, zero on string queued, otherwise dropped (too little space)
+int SCI0_TxQueueString (char * buff);
+
+// non-blocking send of len bytes through the transmit queue (may contain zeros)
+// all or nothing, zero on data queued, otherwise dropped (too little space)
+int SCI0_TxQueueData (unsigned char * data, unsigned char len);
+
+// number of bytes that can currently be queued without dropping
+unsigned char SCI0_TxFree (void);
+
+// number of bytes dropped because the transmit queue was full
+unsigned int SCI0_TxDropped (void);
+
+// call from USART_UDRE_vect, moves the next queued byte into UDR0
+void SCI0_TxISR (void);
+
+// non-blocking read from the receive queue
+// zero on byte read, otherwise no byte to read
+int SCI0_RxQueueByte (unsigned char * pData);
+
+// number of bytes dropped because the receive queue was full
+unsigned int SCI0_RxDropped (void);
+
+// call from USART_RX_vect, moves UDR0 into the receive queue
+void SCI0_RxISR (void);
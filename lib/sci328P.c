@@ -2,9 +2,27 @@
 // Simon Walker, NAIT
 
 #include <avr/io.h>
+#include <avr/interrupt.h>
 #include <stdio.h>
 #include "sci.h"
 
+// transmit queue, head written by the main line, tail by the UDRE ISR
+// (8-bit indices so each side can read the other's without a critical section)
+static volatile unsigned char _TxBuff[SCI0_TX_BUFFER_SIZE];
+static volatile unsigned char _TxHead = 0;
+static volatile unsigned char _TxTail = 0;
+static volatile unsigned int _TxDropped = 0;
+
+#define SCI0_TX_MASK (SCI0_TX_BUFFER_SIZE - 1)
+
+// receive queue, head written by the RX ISR, tail by the main line
+static volatile unsigned char _RxBuff[SCI0_RX_BUFFER_SIZE];
+static volatile unsigned char _RxHead = 0;
+static volatile unsigned char _RxTail = 0;
+static volatile unsigned int _RxDropped = 0;
+
+#define SCI0_RX_MASK (SCI0_RX_BUFFER_SIZE - 1)
+
 int SCI0_Init (unsigned long ulBus, unsigned long ulBAUD, int bRXInt)
 {
   // determine the BAUD rate divisor required
@@ -79,3 +97,126 @@ int SCI0_RxByte (unsigned char * pData)
   
   return 1;
 }
+
+unsigned char SCI0_TxFree (void)
+{
+  // one slot is always left open to tell full from empty
+  return (unsigned char)(SCI0_TX_MASK - ((_TxHead - _TxTail) & SCI0_TX_MASK));
+}
+
+unsigned int SCI0_TxDropped (void)
+{
+  unsigned int uiDropped;
+
+  // 16-bit value is also written by the main line only, but keep the read whole
+  unsigned char sreg = SREG;
+  cli();
+  uiDropped = _TxDropped;
+  SREG = sreg;
+
+  return uiDropped;
+}
+
+int SCI0_TxQueueByte (unsigned char data)
+{
+  return SCI0_TxQueueData(&data, 1);
+}
+
+int SCI0_TxQueueString (char * buff)
+{
+  unsigned int len = 0;
+  while (buff[len])
+    ++len;
+
+  // can never fit, drop it all
+  if (len > SCI0_TX_MASK)
+  {
+    _TxDropped += len;
+    return -1;
+  }
+
+  return SCI0_TxQueueData((unsigned char *)buff, (unsigned char)len);
+}
+
+int SCI0_TxQueueData (unsigned char * data, unsigned char len)
+{
+  unsigned char head = _TxHead;
+
+  // partial frames are worse than missing ones, so drop the lot
+  if (len > SCI0_TxFree())
+  {
+    _TxDropped += len;
+    return -1;
+  }
+
+  while (len--)
+  {
+    _TxBuff[head] = *data++;
+    head = (head + 1) & SCI0_TX_MASK;
+  }
+
+  // publish the new bytes, then make sure the ISR is running to drain them
+  _TxHead = head;
+  UCSR0B |= (1 << UDRIE0);
+
+  return 0;
+}
+
+void SCI0_TxISR (void)
+{
+  unsigned char tail = _TxTail;
+
+  // nothing left, stop the data register empty interrupt until more is queued
+  if (tail == _TxHead)
+  {
+    UCSR0B &= ~(1 << UDRIE0);
+    return;
+  }
+
+  UDR0 = _TxBuff[tail];
+  _TxTail = (tail + 1) & SCI0_TX_MASK;
+}
+
+int SCI0_RxQueueByte (unsigned char * pData)
+{
+  unsigned char tail = _RxTail;
+
+  if (tail == _RxHead)
+    return 1;
+
+  *pData = _RxBuff[tail];
+  _RxTail = (tail + 1) & SCI0_RX_MASK;
+
+  return 0;
+}
+
+unsigned int SCI0_RxDropped (void)
+{
+  unsigned int uiDropped;
+
+  // 16-bit value is written by the RX ISR, so read it with interrupts off
+  unsigned char sreg = SREG;
+  cli();
+  uiDropped = _RxDropped;
+  SREG = sreg;
+
+  return uiDropped;
+}
+
+void SCI0_RxISR (void)
+{
+  // reading UDR0 clears the interrupt, so always pull the byte
+  unsigned char data = UDR0;
+  unsigned char head = _RxHead;
+  unsigned char next = (head + 1) & SCI0_RX_MASK;
+
+  // no room, count it and lose it
+  if (next == _RxTail)
+  {
+    ++_RxDropped;
+    return;
+  }
+
+  _RxBuff[head] = data;
+  _RxHead = next;
+}
@@ -16,6 +16,15 @@ ISR(TIMER1_COMPA_vect)
 }
 */
 
+// model of timer overflow ISR, required once Timer_InitNow is called
+/*
+// overflow interrupt, extends TCNT1 for Timer_Now
+ISR(TIMER1_OVF_vect)
+{
+	Timer_OverflowISR();
+}
+*/
+
 typedef enum Timer_Prescale
 {
 	Timer_Prescale_1 = 1,
@@ -53,3 +62,16 @@ void Timer_Init (Timer_Prescale pre, unsigned int uiInitialOffset);
 
 // bring up timer 0 in fast PWM mode
 void Timer_F_PWM0 (Timer_PWM_Channel chan, Timer_PWM_ClockSel clksel, Timer_PWM_Pol pol);
+
+// start tracking timer 1 overflows so Timer_Now can extend TCNT1 to 32 bits
+// call after Timer_Init, requires TIMER1_OVF_vect to call Timer_OverflowISR
+void Timer_InitNow (void);
+
+// 32-bit monotonic time in timer 1 counts (TCNT1 plus overflows), safe from ISRs and main
+unsigned long Timer_Now (void);
+
+// extend a 16-bit timer 1 value captured within the last overflow period (eg. ICR1) to 32 bits
+unsigned long Timer_Extend (unsigned int uiCount);
+
+// call from TIMER1_OVF_vect
+void Timer_OverflowISR (void);
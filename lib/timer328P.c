@@ -2,8 +2,12 @@
 // Simon Walker, NAIT
 
 #include <avr/io.h>
+#include <avr/interrupt.h>
 #include "timer.h"
 
+// upper 16 bits of Timer_Now, bumped on every timer 1 overflow
+static volatile unsigned int _Overflows = 0;
+
 void Timer_Init (Timer_Prescale pre, unsigned int uiInitialOffset)
 {
 	// start code will power off all modules...
@@ -23,6 +27,45 @@ void Timer_Init (Timer_Prescale pre, unsigned int uiInitialOffset)
 	TIMSK1 = 0b00000010;
 }
 
+void Timer_InitNow (void)
+{
+	// clear any stale overflow, then count them from here on
+	TIFR1 = (1 << TOV1);
+	TIMSK1 |= (1 << TOIE1);
+}
+
+unsigned long Timer_Now (void)
+{
+	unsigned int uiHigh;
+	unsigned int uiLow;
+
+	// counter and overflow count have to come from the same moment
+	unsigned char sreg = SREG;
+	cli();
+	uiHigh = _Overflows;
+	uiLow = TCNT1;
+	// wrapped, but the overflow ISR hasn't had a chance to run yet
+	// (low half check so a wrap just after the TCNT1 read isn't counted twice)
+	if ((TIFR1 & (1 << TOV1)) && uiLow < 0x8000)
+		++uiHigh;
+	SREG = sreg;
+
+	return ((unsigned long)uiHigh << 16) | uiLow;
+}
+
+unsigned long Timer_Extend (unsigned int uiCount)
+{
+	unsigned long ulNow = Timer_Now();
+
+	// how far back the captured value is, modulo 16 bits
+	return ulNow - (unsigned int)((unsigned int)ulNow - uiCount);
+}
+
+void Timer_OverflowISR (void)
+{
+	++_Overflows;
+}
+
 void Timer_F_PWM0 (Timer_PWM_Channel chan, Timer_PWM_ClockSel clksel, Timer_PWM_Pol pol)
 {
   // setup fast PWM mode (closest to what we did in micro)
@@ -0,0 +1,100 @@
+// Trace library
+// Events are 7 bytes, TRACE_BUFFER_SIZE of them, only built with TRACE_ENABLED
+
+#include "trace.h"
+
+#ifdef TRACE_ENABLED
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "timer.h"
+
+// ring of events, _TraceHead is the next slot written, _TraceCount how many are valid
+static struct TraceEvent _TraceBuff[TRACE_BUFFER_SIZE];
+static volatile unsigned char _TraceHead = 0;
+static volatile unsigned char _TraceCount = 0;
+// events overwritten (or held off during a dump) since the last dump
+static volatile unsigned int _TraceLost = 0;
+// events left to send in the current dump, 0xFF before the header goes out, 0 when idle
+static volatile unsigned char _TraceDumpLeft = 0;
+static volatile char _TraceDumping = 0;
+
+void Trace_Record (Trace_Id id, unsigned int arg)
+{
+	unsigned long now = Timer_Now();
+
+	// head and count move together, an ISR can't be allowed in between
+	unsigned char sreg = SREG;
+	cli();
+	// the ring is being sent, leave it as it was when the dump started
+	if (_TraceDumping)
+	{
+		++_TraceLost;
+	}
+	else
+	{
+		_TraceBuff[_TraceHead].Id = id;
+		_TraceBuff[_TraceHead].Time = now;
+		_TraceBuff[_TraceHead].Arg = arg;
+		_TraceHead = (_TraceHead + 1) & (TRACE_BUFFER_SIZE - 1);
+		if (_TraceCount < TRACE_BUFFER_SIZE)
+			++_TraceCount;
+		else
+			++_TraceLost;
+	}
+	SREG = sreg;
+}
+
+void Trace_StartDump (void)
+{
+	// one at a time
+	if (_TraceDumping)
+		return;
+
+	_TraceDumping = 1;
+	_TraceDumpLeft = 0xFF;
+}
+
+char Trace_NextDump (struct TraceEvent * event)
+{
+	if (!_TraceDumping)
+		return 0;
+
+	// recording is held off, so nothing else touches the ring until the dump is done
+	if (_TraceDumpLeft == 0xFF)
+	{
+		// header, then the events oldest first
+		event->Id = Trace_DumpHeader;
+		event->Time = _TraceCount;
+		// anything held off from here on goes in the next dump's count
+		unsigned char sreg = SREG;
+		cli();
+		event->Arg = _TraceLost;
+		_TraceLost = 0;
+		SREG = sreg;
+		_TraceDumpLeft = _TraceCount;
+	}
+	else if (_TraceDumpLeft)
+	{
+		*event = _TraceBuff[(_TraceHead - _TraceDumpLeft) & (TRACE_BUFFER_SIZE - 1)];
+		--_TraceDumpLeft;
+	}
+
+	// all handed out, start recording into an empty ring
+	if (!_TraceDumpLeft)
+	{
+		unsigned char sreg = SREG;
+		cli();
+		_TraceCount = 0;
+		_TraceDumping = 0;
+		SREG = sreg;
+	}
+	return 1;
+}
+
+void Trace_CancelDump (void)
+{
+	_TraceDumping = 0;
+}
+
+#endif
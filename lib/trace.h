@@ -0,0 +1,68 @@
+// Trace library, flight recorder for ISRs and main
+// Revision History:
+// October 17 2026 - Initial Build
+
+// Fixed size binary events (id, Timer_Now time, 16 bit arg) go into a RAM ring, the oldest
+// being overwritten once it's full. Trace_StartDump freezes the ring and Trace_NextDump hands it back
+// an event at a time for whoever owns the port to send (pico.c writes the lines below, only in the
+// ASCII frame format), decode with tools/trace_decode.py
+//
+// Only built when TRACE_ENABLED is defined (Debug configuration), otherwise the TRACE_ macros
+// expand to nothing and the ring doesn't exist, so trace points cost nothing in Release
+
+// number of events held, must be a power of 2 (max 128), 7 bytes each
+#ifndef TRACE_BUFFER_SIZE
+#define TRACE_BUFFER_SIZE 32
+#endif
+
+// dump lines (ASCII, so they can share the port with frames)
+//  header: %T<count, 2 hex><events lost since the last dump, 4 hex>\n
+//  event:  %<id, 2 hex><time, 8 hex><arg, 4 hex>\n, oldest first
+#define TRACE_DUMP_START_BYTE '%'
+#define TRACE_DUMP_HEADER_BYTE 'T'
+#define TRACE_DUMP_LINE_LENGTH 16
+
+// event ids, keep tools/trace_decode.py in step
+typedef enum
+{
+	Trace_DumpHeader = 0,   // only from Trace_NextDump: Time = events to follow, Arg = events lost
+	Trace_PingFire = 1,     // arg: HCSR04 device | slot << 8
+	Trace_EchoStart = 2,    // arg: HCSR04 device
+	Trace_PingDone = 3,     // arg: HCSR04 device | HCSR04 status << 8
+	Trace_FrameSent = 4,    // arg: sequence | 0x100 if the transmit queue dropped it
+	Trace_Command = 5,      // arg: command letter from the pico
+	Trace_Temperature = 6,  // arg: LM75A temperature, 1/8 degrees C
+	Trace_WeightEvent = 7   // arg: GD03 event type | 0x100 if the transmit queue dropped it
+} Trace_Id;
+
+struct TraceEvent
+{
+	unsigned char Id;
+	unsigned long Time;
+	unsigned int Arg;
+};
+
+#ifdef TRACE_ENABLED
+
+// record an event, safe from ISRs and main
+#define TRACE(id, arg) Trace_Record((id), (arg))
+// start sending the ring out, events are held off until it's done
+#define TRACE_DUMP() Trace_StartDump()
+
+void Trace_Record (Trace_Id id, unsigned int arg);
+
+void Trace_StartDump (void);
+
+// next record of the dump into event, the header first and then the events oldest first
+// returns 0 when no dump is running, recording starts again once the last one is handed out
+char Trace_NextDump (struct TraceEvent * event);
+
+// abandon a dump part way (eg. the port went binary), what's left stays in the ring
+void Trace_CancelDump (void);
+
+#else
+
+#define TRACE(id, arg) ((void)0)
+#define TRACE_DUMP() ((void)0)
+
+#endif
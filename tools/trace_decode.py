@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+"""
+Decode a trace dump (lib/trace.h) captured from the MCU's UART.
+
+Reads the capture from a file, stdin, or straight from a serial port (needs pyserial),
+picks out the trace lines and prints one event per line, with times in ms relative to
+the first event of each dump. Anything else on the port (frames) is ignored.
+
+    python3 trace_decode.py capture.txt
+    python3 trace_decode.py --port /dev/ttyUSB0      (send !T0^ to the MCU to start a dump)
+"""
+
+import argparse
+import sys
+
+START = "%"
+HEADER = "T"
+TIMER_US_PER_COUNT = 0.5  # Timer_Now counts, timer 1 at prescale 8
+
+# keep in step with Trace_Id in lib/trace.h
+DEVICES = {0: "US L", 1: "US C", 2: "US R"}
+STATUSES = {0: "idle", 1: "pending", 2: "ready", 3: "no echo", 4: "crosstalk"}
+WEIGHT_EVENTS = {1: "placed", 2: "removed", 3: "changed"}
+
+
+def ping_fire(arg):
+    return "%s slot %d" % (DEVICES.get(arg & 0xFF, arg & 0xFF), arg >> 8)
+
+
+def echo_start(arg):
+    return DEVICES.get(arg & 0xFF, str(arg & 0xFF))
+
+
+def ping_done(arg):
+    return "%s %s" % (DEVICES.get(arg & 0xFF, arg & 0xFF), STATUSES.get(arg >> 8, arg >> 8))
+
+
+def frame_sent(arg):
+    return "seq %d%s" % (arg & 0xFF, " DROPPED" if arg & 0x100 else "")
+
+
+def command(arg):
+    return "'%s'" % chr(arg & 0xFF)
+
+
+def weight_event(arg):
+    kind = WEIGHT_EVENTS.get(arg & 0xFF, arg & 0xFF)
+    return "%s%s" % (kind, " DROPPED" if arg & 0x100 else "")
+
+
+def temperature(arg):
+    if arg & 0x8000:
+        arg -= 0x10000
+    return "%.3f C" % (arg / 8.0)
+
+
+EVENTS = {
+    1: ("PingFire", ping_fire),
+    2: ("EchoStart", echo_start),
+    3: ("PingDone", ping_done),
+    4: ("FrameSent", frame_sent),
+    5: ("Command", command),
+    6: ("Temperature", temperature),
+    7: ("WeightEvent", weight_event),
+}
+
+
+def lines_from(args):
+    if args.port:
+        import serial  # pyserial
+
+        with serial.Serial(args.port, args.baud, timeout=1) as port:
+            while True:
+                yield port.readline().decode("ascii", "replace")
+    else:
+        source = open(args.file, "r", errors="replace") if args.file else sys.stdin
+        for line in source:
+            yield line
+
+
+def decode(lines, out):
+    start = None
+    for line in lines:
+        line = line.strip()
+        # frames and anything else on the port
+        if not line.startswith(START):
+            continue
+        body = line[1:]
+        try:
+            if body.startswith(HEADER) and len(body) == 7:
+                count = int(body[1:3], 16)
+                lost = int(body[3:7], 16)
+                out.write("--- dump: %d events, %d lost since the last dump\n" % (count, lost))
+                start = None
+            elif len(body) == 14:
+                event = int(body[0:2], 16)
+                time = int(body[2:10], 16)
+                arg = int(body[10:14], 16)
+                if start is None:
+                    start = time
+                # Timer_Now is 32 bits, wraps every ~35 minutes
+                elapsed = ((time - start) & 0xFFFFFFFF) * TIMER_US_PER_COUNT / 1000.0
+                name, describe = EVENTS.get(event, ("Unknown(%d)" % event, lambda a: "0x%04X" % a))
+                out.write("%10.3f ms  %-12s %s\n" % (elapsed, name, describe(arg)))
+        except ValueError:
+            out.write("bad trace line: %s\n" % line)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("file", nargs="?", help="captured output (default: stdin)")
+    parser.add_argument("--port", help="serial port to read from instead")
+    parser.add_argument("--baud", type=int, default=56000, help="PICO_BAUD_RATE (default 56000)")
+    args = parser.parse_args()
+    decode(lines_from(args), sys.stdout)
+
+
+if __name__ == "__main__":
+    main()